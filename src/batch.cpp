@@ -0,0 +1,195 @@
+
+#include <new>
+#include <string>
+#include <cstring>
+#include <vector>
+#include <algorithm>
+#include "batch.h"
+#include "convert.h"
+#include "reader.h"
+#include "parallel.h"
+
+namespace fbmp
+{
+
+	namespace
+	{
+		//bytes of one slot row and slot plane, planes is 1 for interleaved and gray slots
+		struct slot_layout
+		{
+			size_t row_size;
+			size_t pitch;
+			size_t plane_stride;
+			size_t planes;
+		};
+
+		slot_layout layout_of(const batch_target& batch)
+		{
+			const decode_target& target = batch.target;
+			const size_t channels = target.format == pixel_format::native ? batch.channels : 1;
+			const size_t sample = sample_size(target.type);
+			const bool interleaved = target.layout == pixel_layout::interleaved || channels == 1;
+
+			slot_layout slot;
+			slot.row_size = batch.width * sample * (interleaved ? channels : 1);
+			slot.pitch = target.pitch ? target.pitch : slot.row_size;
+			slot.plane_stride = !interleaved && target.plane_stride ? target.plane_stride : slot.pitch * batch.height;
+			slot.planes = interleaved ? 1 : channels;
+
+			if (slot.pitch < slot.row_size || slot.plane_stride < slot.pitch * batch.height)
+				throw exception(error_code::invalid_argument, "Batch slot is too small.");
+			return slot;
+		}
+
+		//a whole slot row of pad samples in the slot's sample type
+		std::vector<uint8_t> pad_row(const slot_layout& slot, sample_type type, float value)
+		{
+			std::vector<uint8_t> row(slot.row_size);
+			const size_t sample = sample_size(type);
+			for (size_t i = 0; i + sample <= row.size(); i += sample)
+			{
+				if (type == sample_type::u8)
+					row[i] = (uint8_t)std::min(std::max(value + 0.5f, 0.0f), 255.0f);
+				else if (type == sample_type::f32)
+					memcpy(&row[i], &value, sizeof(float));
+				else
+				{
+					const uint16_t half = type == sample_type::f16 ? float_to_half(value) : float_to_bfloat16(value);
+					memcpy(&row[i], &half, sizeof(uint16_t));
+				}
+			}
+			return row;
+		}
+
+		//pads the right of the first height rows and everything below them, in every plane
+		//row_used is a whole number of samples, so any part of the pad row holds whole samples
+		void pad_slot(uint8_t* data, const slot_layout& slot, size_t slot_height, size_t row_used, size_t height, const uint8_t* pad)
+		{
+			for (size_t p = 0; p < slot.planes; ++p)
+			{
+				uint8_t* plane = data + p * slot.plane_stride;
+				for (size_t y = 0; y < slot_height; ++y)
+				{
+					const size_t used = y < height ? row_used : 0;
+					memcpy(plane + y * slot.pitch + used, pad, slot.row_size - used);
+				}
+			}
+		}
+
+		std::string size_text(size_t width, size_t height)
+		{
+			return std::to_string(width) + "x" + std::to_string(height);
+		}
+
+		//everything the images of one batch share, checked once before any image is read
+		struct batch_plan
+		{
+			const batch_target* batch;
+			slot_layout slot;
+			size_t stride;
+			size_t channels;
+			bool swapped;
+			std::vector<uint8_t> pad;	//one slot row of pad samples
+		};
+
+		batch_plan plan_of(const batch_target& batch)
+		{
+			const decode_target& target = batch.target;
+			if (target.format != pixel_format::native && target.format != pixel_format::gray)
+				throw exception(error_code::invalid_argument, "Batch decode supports native and gray targets only.");
+
+			batch_plan plan;
+			plan.batch = &batch;
+			plan.slot = layout_of(batch);
+			plan.stride = batch.image_stride ? batch.image_stride : plan.slot.plane_stride * plan.slot.planes;
+			if (plan.stride < plan.slot.plane_stride * plan.slot.planes)
+				throw exception(error_code::invalid_argument, "Batch image stride is smaller than a slot.");
+
+			plan.channels = target.format == pixel_format::native ? batch.channels : 1;
+			plan.swapped = target.rotate == rotation::rotate_90 || target.rotate == rotation::rotate_270;
+			if (batch.policy == size_policy::pad)
+				plan.pad = pad_row(plan.slot, target.type, batch.pad_value);
+			return plan;
+		}
+
+		status decode_slot(const batch_plan& plan, input_stream* input, size_t i) noexcept
+		{
+			const batch_target& batch = *plan.batch;
+			const decode_target& target = batch.target;
+
+			if (!input)
+				return status(error_code::invalid_argument, "Batch image " + std::to_string(i) + " has no input stream.");
+			reader decoder(input);
+			input_stream_handle stream_handle(*input, std::nothrow);
+
+			status result = stream_handle.get_status();
+			if (result)
+				result = decoder.try_read_header();
+			if (result)
+				result = decoder.try_read_dib_header();
+			if (result)
+				result = decoder.try_read_palette();
+			if (!result)
+				return result;
+
+			const bmp_info& info = decoder.get_info();
+			const size_t width = plan.swapped ? info.abs_height() : (size_t)info.width;
+			const size_t height = plan.swapped ? (size_t)info.width : info.abs_height();
+			const std::string name = "Batch image " + std::to_string(i) + " ";
+
+			if (target.format == pixel_format::native && decoder.output_channels() != plan.channels)
+				return status(error_code::invalid_argument, name + "has " + std::to_string(decoder.output_channels()) + " channels, expected " + std::to_string(plan.channels) + ".");
+
+			const bool smaller = width < batch.width || height < batch.height;
+			if (width > batch.width || height > batch.height || (smaller && batch.policy == size_policy::reject))
+				return status(error_code::invalid_argument, name + "is " + size_text(width, height) + ", expected " + size_text(batch.width, batch.height) + ".");
+
+			decode_target image_target = target;
+			image_target.data = target.data + i * plan.stride;
+			image_target.pitch = plan.slot.pitch;
+			image_target.plane_stride = plan.slot.plane_stride;
+			result = decoder.try_decode_image(image_target);
+
+			if (result && smaller)
+				pad_slot(image_target.data, plan.slot, batch.height, plan.slot.row_size / batch.width * width, height, plan.pad.data());
+			return result;
+		}
+	}
+
+	size_t batch_target::slot_size() const
+	{
+		const slot_layout slot = layout_of(*this);
+		return slot.plane_stride * slot.planes;
+	}
+
+	void decode_batch(input_stream* const* inputs, size_t count, const batch_target& batch, size_t threads)
+	{
+		const batch_plan plan = plan_of(batch);
+		parallel_for(count, threads, [&](size_t i)
+		{
+			throw_if_error(decode_slot(plan, inputs[i], i));
+		});
+	}
+
+	status try_decode_batch(input_stream* const* inputs, size_t count, const batch_target& batch, status* results, size_t threads) noexcept
+	{
+		try
+		{
+			const batch_plan plan = plan_of(batch);
+			parallel_for(count, threads, [&](size_t i)
+			{
+				results[i] = decode_slot(plan, inputs[i], i);
+			});
+			return status();
+		}
+		catch (const exception& e)
+		{
+			return status(e.code(), e.what());
+		}
+		catch (const std::exception& e)
+		{
+			return status(error_code::unknown, e.what());
+		}
+	}
+
+}
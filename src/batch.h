@@ -0,0 +1,47 @@
+
+#pragma once
+#ifndef FBMP_BATCH_H
+#define FBMP_BATCH_H
+
+#include <cstdint>
+#include <cstddef>
+
+#include "status.h"
+#include "stream.h"
+#include "decode_target.h"
+
+namespace fbmp
+{
+
+	enum class size_policy
+	{
+		reject,	//images of another size throw
+		pad		//smaller images go to the top left corner, the rest of the slot is filled with pad_value
+	};
+
+	//count images of one shape decoded straight into a caller owned arena
+	//image i is written to target.data + i * image_stride, target describes the slot of a single image
+	struct batch_target
+	{
+		decode_target target;			//native or gray format
+		size_t width = 0;				//size of a slot, after rotation
+		size_t height = 0;
+		size_t channels = 3;			//images decoding to another channel count are rejected with either policy
+		size_t image_stride = 0;		//bytes between slots, 0 - slot_size()
+		size_policy policy = size_policy::reject;
+		float pad_value = 0;			//every padded sample: a byte value for u8 slots, the sample itself for float ones
+
+		size_t slot_size() const;
+	};
+
+	//every stream is read from its current position, threads splits the images between worker threads
+	//the first failing image stops the batch and its error is rethrown, slots of other images may be partly written
+	void decode_batch(input_stream* const* inputs, size_t count, const batch_target& batch, size_t threads = 1);
+
+	//every image is decoded whatever happens to the others, results[i] is the outcome of image i
+	//the returned status is an error only for a batch_target no image fits, then results are not written
+	status try_decode_batch(input_stream* const* inputs, size_t count, const batch_target& batch, status* results, size_t threads = 1) noexcept;
+
+}
+
+#endif //FBMP_BATCH_H
@@ -0,0 +1,254 @@
+
+#include <cstring>
+#include "convert.h"
+#include "simd.h"
+
+namespace fbmp
+{
+
+	const color_weights& gray_weights(color_matrix matrix)
+	{
+		static const color_weights bt601 = { { 77, 150, 29 }, 0, { 0, 0, 0 }, { 0, 0, 0 } };
+		static const color_weights bt709 = { { 54, 183, 19 }, 0, { 0, 0, 0 }, { 0, 0, 0 } };
+		return matrix == color_matrix::bt709 ? bt709 : bt601;
+	}
+
+	const color_weights& yuv_weights(color_matrix matrix)
+	{
+		static const color_weights bt601 = { { 66, 129, 25 }, 16, { -38, -74, 112 }, { 112, -94, -18 } };
+		static const color_weights bt709 = { { 47, 157, 16 }, 16, { -26, -87, 113 }, { 112, -102, -10 } };
+		return matrix == color_matrix::bt709 ? bt709 : bt601;
+	}
+
+	uint16_t float_to_half(float value)
+	{
+		uint32_t bits;
+		memcpy(&bits, &value, sizeof(bits));
+
+		const uint32_t sign = (bits >> 16) & 0x8000;
+		uint32_t mantissa = bits & 0x7FFFFF;
+
+		if ((bits & 0x7F800000) == 0x7F800000)
+			return (uint16_t)(sign | 0x7C00 | (mantissa ? 0x200 : 0));
+
+		const int32_t exponent = (int32_t)((bits >> 23) & 0xFF) - 127 + 15;
+		if (exponent <= 0)
+		{
+			if (exponent < -10)
+				return (uint16_t)sign;
+
+			mantissa |= 0x800000;
+			const int shift = 14 - exponent;
+			uint32_t half = mantissa >> shift;
+			const uint32_t rest = mantissa & ((1u << shift) - 1);
+			const uint32_t halfway = 1u << (shift - 1);
+			if (rest > halfway || (rest == halfway && (half & 1)))
+				++half;
+			return (uint16_t)(sign | half);
+		}
+
+		if (exponent >= 31)
+			return (uint16_t)(sign | 0x7C00);
+
+		//rounding may carry into the exponent, which correctly overflows to infinity
+		uint32_t half = sign | ((uint32_t)exponent << 10) | (mantissa >> 13);
+		const uint32_t rest = mantissa & 0x1FFF;
+		if (rest > 0x1000 || (rest == 0x1000 && (half & 1)))
+			++half;
+		return (uint16_t)half;
+	}
+
+	uint16_t float_to_bfloat16(float value)
+	{
+		uint32_t bits;
+		memcpy(&bits, &value, sizeof(bits));
+
+		if ((bits & 0x7F800000) == 0x7F800000 && (bits & 0x7FFFFF))
+			return (uint16_t)((bits >> 16) | 0x40);
+
+		bits += 0x7FFF + ((bits >> 16) & 1);
+		return (uint16_t)(bits >> 16);
+	}
+
+	namespace
+	{
+		template <sample_type type>
+		struct sample_store;
+
+		template <>
+		struct sample_store<sample_type::f32>
+		{
+			static void store(void* dst, size_t i, float value) { static_cast<float*>(dst)[i] = value; }
+#if defined(FBMP_SSE2)
+			static void store4(void* dst, size_t i, __m128 value) { _mm_storeu_ps(static_cast<float*>(dst) + i, value); }
+#endif
+		};
+
+		template <>
+		struct sample_store<sample_type::f16>
+		{
+			static void store(void* dst, size_t i, float value) { static_cast<uint16_t*>(dst)[i] = float_to_half(value); }
+#if defined(FBMP_SSE2)
+			static void store4(void* dst, size_t i, __m128 value)
+			{
+#if defined(FBMP_F16C)
+				_mm_storel_epi64(reinterpret_cast<__m128i*>(static_cast<uint16_t*>(dst) + i), _mm_cvtps_ph(value, 0));
+#else
+				float values[4];
+				_mm_storeu_ps(values, value);
+				for (int k = 0; k < 4; ++k)
+					store(dst, i + k, values[k]);
+#endif
+			}
+#endif
+		};
+
+		template <>
+		struct sample_store<sample_type::bf16>
+		{
+			static void store(void* dst, size_t i, float value) { static_cast<uint16_t*>(dst)[i] = float_to_bfloat16(value); }
+#if defined(FBMP_SSE2)
+			//round to nearest even on the upper half, the arithmetic shift keeps packs_epi32 lossless
+			static void store4(void* dst, size_t i, __m128 value)
+			{
+				__m128i bits = _mm_castps_si128(value);
+				const __m128i lsb = _mm_and_si128(_mm_srli_epi32(bits, 16), _mm_set1_epi32(1));
+				bits = _mm_add_epi32(bits, _mm_add_epi32(lsb, _mm_set1_epi32(0x7FFF)));
+				bits = _mm_srai_epi32(bits, 16);
+				_mm_storel_epi64(reinterpret_cast<__m128i*>(static_cast<uint16_t*>(dst) + i), _mm_packs_epi32(bits, bits));
+			}
+#endif
+		};
+
+		template <sample_type type>
+		void convert_samples_impl(const uint8_t* src, size_t count, void* dst, const float* scale, const float* bias)
+		{
+			typedef sample_store<type> store;
+			size_t i = 0;
+
+#if defined(FBMP_SSE2)
+			//48 bytes are 12 vectors of 4 floats, so the 12 entry pattern lines up with every third vector
+			const __m128 s[3] = { _mm_loadu_ps(scale), _mm_loadu_ps(scale + 4), _mm_loadu_ps(scale + 8) };
+			const __m128 b[3] = { _mm_loadu_ps(bias), _mm_loadu_ps(bias + 4), _mm_loadu_ps(bias + 8) };
+			const __m128i zero = _mm_setzero_si128();
+
+			for (; i + 48 <= count; i += 48)
+			{
+				for (int k = 0; k < 3; ++k)
+				{
+					const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i + k * 16));
+					const __m128i lo = _mm_unpacklo_epi8(bytes, zero);
+					const __m128i hi = _mm_unpackhi_epi8(bytes, zero);
+					const __m128 v0 = _mm_cvtepi32_ps(_mm_unpacklo_epi16(lo, zero));
+					const __m128 v1 = _mm_cvtepi32_ps(_mm_unpackhi_epi16(lo, zero));
+					const __m128 v2 = _mm_cvtepi32_ps(_mm_unpacklo_epi16(hi, zero));
+					const __m128 v3 = _mm_cvtepi32_ps(_mm_unpackhi_epi16(hi, zero));
+
+					const size_t j = k * 4;
+					store::store4(dst, i + j * 4 + 0, _mm_add_ps(_mm_mul_ps(v0, s[(j + 0) % 3]), b[(j + 0) % 3]));
+					store::store4(dst, i + j * 4 + 4, _mm_add_ps(_mm_mul_ps(v1, s[(j + 1) % 3]), b[(j + 1) % 3]));
+					store::store4(dst, i + j * 4 + 8, _mm_add_ps(_mm_mul_ps(v2, s[(j + 2) % 3]), b[(j + 2) % 3]));
+					store::store4(dst, i + j * 4 + 12, _mm_add_ps(_mm_mul_ps(v3, s[(j + 3) % 3]), b[(j + 3) % 3]));
+				}
+			}
+#endif
+
+			for (; i < count; ++i)
+			{
+				const size_t p = i % 12;
+				store::store(dst, i, src[i] * scale[p] + bias[p]);
+			}
+		}
+	}
+
+	void convert_samples(const uint8_t* src, size_t count, void* dst, sample_type type, const float* scale, const float* bias)
+	{
+		switch (type)
+		{
+		case sample_type::f32:
+			convert_samples_impl<sample_type::f32>(src, count, dst, scale, bias);
+			break;
+		case sample_type::f16:
+			convert_samples_impl<sample_type::f16>(src, count, dst, scale, bias);
+			break;
+		case sample_type::bf16:
+			convert_samples_impl<sample_type::bf16>(src, count, dst, scale, bias);
+			break;
+		default:
+			memcpy(dst, src, count);
+			break;
+		}
+	}
+
+	namespace
+	{
+#if defined(FBMP_SSE2)
+		//four pixels of 4 bytes -> four 32-bit luma values, weights hold the three channel weights and 0 twice
+		inline __m128i luma4(__m128i pixels, __m128i weights, __m128i offset)
+		{
+			const __m128i zero = _mm_setzero_si128();
+			const __m128i lo = _mm_madd_epi16(_mm_unpacklo_epi8(pixels, zero), weights);
+			const __m128i hi = _mm_madd_epi16(_mm_unpackhi_epi8(pixels, zero), weights);
+			//the two partial sums of a pixel are adjacent, their totals end up in the even lanes
+			const __m128i lo_sum = _mm_add_epi32(lo, _mm_srli_epi64(lo, 32));
+			const __m128i hi_sum = _mm_add_epi32(hi, _mm_srli_epi64(hi, 32));
+			const __m128i sums = _mm_unpacklo_epi64(_mm_shuffle_epi32(lo_sum, _MM_SHUFFLE(3, 1, 2, 0)), _mm_shuffle_epi32(hi_sum, _MM_SHUFFLE(3, 1, 2, 0)));
+			return _mm_add_epi32(_mm_srai_epi32(_mm_add_epi32(sums, _mm_set1_epi32(128)), 8), offset);
+		}
+
+		inline void store_luma8(uint8_t* dst, __m128i a, __m128i b)
+		{
+			const __m128i words = _mm_packs_epi32(a, b);
+			_mm_storel_epi64(reinterpret_cast<__m128i*>(dst), _mm_packus_epi16(words, words));
+		}
+#endif
+	}
+
+	void luma_row(const uint8_t* src, size_t width, size_t channels, bool bgr, const color_weights& w, uint8_t* dst)
+	{
+		if (channels < 3)
+		{
+			for (size_t x = 0; x < width; ++x)
+				dst[x] = src[x * channels];
+			return;
+		}
+
+		const int32_t first = bgr ? w.y[2] : w.y[0];
+		const int32_t last = bgr ? w.y[0] : w.y[2];
+		size_t x = 0;
+
+#if defined(FBMP_SSE2)
+		const __m128i weights = _mm_setr_epi16((short)first, (short)w.y[1], (short)last, 0, (short)first, (short)w.y[1], (short)last, 0);
+		const __m128i offset = _mm_set1_epi32(w.y_offset);
+		if (channels == 4)
+		{
+			for (; x + 8 <= width; x += 8)
+			{
+				const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + x * 4));
+				const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + x * 4 + 16));
+				store_luma8(dst + x, luma4(a, weights, offset), luma4(b, weights, offset));
+			}
+		}
+#if defined(FBMP_SSSE3)
+		else if (channels == 3)
+		{
+			//3 byte pixels are widened to 4 bytes, the second load ends 4 bytes past the 8th pixel
+			const __m128i widen = _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+			for (; x + 10 <= width; x += 8)
+			{
+				const __m128i a = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + x * 3)), widen);
+				const __m128i b = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + x * 3 + 12)), widen);
+				store_luma8(dst + x, luma4(a, weights, offset), luma4(b, weights, offset));
+			}
+		}
+#endif
+#endif
+
+		for (; x < width; ++x)
+		{
+			const uint8_t* p = src + x * channels;
+			dst[x] = (uint8_t)(((first * p[0] + w.y[1] * p[1] + last * p[2] + 128) >> 8) + w.y_offset);
+		}
+	}
+
+}
@@ -0,0 +1,45 @@
+
+#pragma once
+#ifndef FBMP_CONVERT_H
+#define FBMP_CONVERT_H
+
+#include <cstdint>
+#include <cstddef>
+
+#include "decode_target.h"
+
+namespace fbmp
+{
+
+	//dst[i] = src[i] * scale[i % 12] + bias[i % 12] stored as the requested sample type
+	//the 12 entry pattern covers 1, 3 and 4 interleaved channels
+	void convert_samples(const uint8_t* src, size_t count, void* dst, sample_type type, const float* scale, const float* bias);
+
+	//8-bit fixed point weights applied to R, G, B: (w[0] * r + w[1] * g + w[2] * b + 128) >> 8
+	struct color_weights
+	{
+		int32_t y[3];
+		int32_t y_offset;
+		int32_t u[3];
+		int32_t v[3];
+	};
+
+	//full range luma for gray output, limited (video) range for YUV
+	const color_weights& gray_weights(color_matrix matrix);
+	const color_weights& yuv_weights(color_matrix matrix);
+
+	inline uint8_t weighted_luma(const color_weights& w, uint32_t r, uint32_t g, uint32_t b)
+	{
+		return (uint8_t)(((w.y[0] * (int32_t)r + w.y[1] * (int32_t)g + w.y[2] * (int32_t)b + 128) >> 8) + w.y_offset);
+	}
+
+	//luma of width pixels, channels 1 and 2 copy the first channel
+	//bgr - the first three channels are B, G, R as stored in a file instead of R, G, B
+	void luma_row(const uint8_t* src, size_t width, size_t channels, bool bgr, const color_weights& w, uint8_t* dst);
+
+	uint16_t float_to_half(float value);
+	uint16_t float_to_bfloat16(float value);
+
+}
+
+#endif //FBMP_CONVERT_H
@@ -6,6 +6,7 @@
 #include <cstdint>
 #include <string>
 #include <memory>
+#include <cstring>
 #include "exception.h"
 
 namespace fbmp
@@ -15,10 +16,10 @@ namespace fbmp
 	struct main_header
 	{
 		char magic[2];
-		int32_t file_size = 0;
+		uint32_t file_size = 0;		//0 or truncated for files over 4 GB, never trusted by the decoders
 		int16_t reserved1 = 0;
 		int16_t reserved2 = 0;
-		int32_t offset = 0;
+		uint32_t offset = 0;
 
 		std::string details()
 		{
@@ -45,6 +46,138 @@ namespace fbmp
 		bitmap_v5_header		= 124
 	};
 
+	//every dib header variant flattened into one plain struct, absent fields are 0
+	struct bmp_info
+	{
+		dib_header_type header_type;
+		int32_t header_size;
+
+		int32_t width;
+		int32_t height;			//positive - rows are stored bottom-up
+		int16_t planes;
+		int16_t bit_count;
+		int32_t compression;
+		int32_t image_size;
+		int32_t x_peels_per_meter;
+		int32_t y_peels_per_meter;
+		int32_t palette_colors;
+		int32_t important_colors;
+
+		//v2 and later
+		uint32_t red_mask;
+		uint32_t green_mask;
+		uint32_t blue_mask;
+		//v3 and later
+		uint32_t alpha_mask;
+		//v4 and later, the endpoints and gamma are skipped
+		uint32_t color_space;
+		//v5
+		uint32_t intent;
+		uint32_t profile_data;
+		uint32_t profile_size;
+
+		bool flipped() const { return height > 0; }
+		int32_t abs_height() const { return height < 0 ? -height : height; }
+		int32_t row_size() const { return (int32_t)row_bytes(); } //padding to 4 bytes, fits once the reader has checked the header
+		uint64_t row_bytes() const { return (((uint64_t)(uint16_t)bit_count * (uint32_t)width + 31) / 32) * 4; }
+		size_t palette_entry_size() const { return header_type == dib_header_type::bitmap_core_header ? 3 : 4; }
+		//bi_bitfields masks of a 40 byte header follow it, where a palette would be
+		size_t trailing_mask_bytes() const { return header_size == 40 && compression == 3 ? 3 * sizeof(uint32_t) : 0; }
+		void parse_trailing_masks(const uint8_t* masks)
+		{
+			memcpy(&red_mask, masks, sizeof(uint32_t));
+			memcpy(&green_mask, masks + 4, sizeof(uint32_t));
+			memcpy(&blue_mask, masks + 8, sizeof(uint32_t));
+		}
+
+		static const int32_t max_header_size = 124;
+
+		//header points to header_size bytes starting with the size field
+		static bmp_info parse(const uint8_t* header, int32_t header_size);
+
+		std::string details() const
+		{
+			return std::string("DIB header: ")
+				+ "\n" "Size: " + std::to_string(header_size)
+				+ "\n" "Width: " + std::to_string(width)
+				+ "\n" "Height: " + std::to_string(height)
+				+ "\n" "Planes: " + std::to_string(planes)
+				+ "\n" "Bit Count: " + std::to_string(bit_count)
+				+ "\n" "Compression: " + std::to_string(compression)
+				+ "\n" "Image Size: " + std::to_string(image_size)
+				+ "\n" "X Peels Per Meter: " + std::to_string(x_peels_per_meter)
+				+ "\n" "Y Peels Per Meter: " + std::to_string(y_peels_per_meter)
+				+ "\n" "Palette Colors: " + std::to_string(palette_colors)
+				+ "\n" "Important Colors: " + std::to_string(important_colors)
+				+ "\n\n";
+		}
+	};
+
+	inline bmp_info bmp_info::parse(const uint8_t* header, int32_t header_size)
+	{
+		if (header_size != 12 && (header_size < 16 || header_size > max_header_size))
+			throw exception(error_code::bad_header, std::string("Unsuppoerted bitmap dib header size - ") + std::to_string(header_size));
+
+		bmp_info info;
+		memset(&info, 0, sizeof(info));
+		info.header_size = header_size;
+
+		//fields past the end of a shorter header stay 0
+		auto field = [&](int32_t offset, void* value, size_t size)
+		{
+			if (offset + (int32_t)size <= header_size)
+				memcpy(value, header + offset, size);
+		};
+
+		if (header_size == 12)
+		{
+			int16_t width = 0, height = 0;
+			field(4, &width, 2);
+			field(6, &height, 2);
+			field(8, &info.planes, 2);
+			field(10, &info.bit_count, 2);
+			info.header_type = dib_header_type::bitmap_core_header;
+			info.width = width;
+			info.height = height;
+			return info;
+		}
+
+		switch (header_size)
+		{
+		case 40: info.header_type = dib_header_type::bitmap_info_header; break;
+		case 52: info.header_type = dib_header_type::bitmap_v2_info_header; break;
+		case 56: info.header_type = dib_header_type::bitmap_v3_info_header; break;
+		case 108: info.header_type = dib_header_type::bitmap_v4_header; break;
+		case 124: info.header_type = dib_header_type::bitmap_v5_header; break;
+		default: info.header_type = header_size <= 64 ? dib_header_type::bitmap_core_header2 : dib_header_type::bitmap_unknown_header; break;
+		}
+
+		field(4, &info.width, 4);
+		field(8, &info.height, 4);
+		field(12, &info.planes, 2);
+		field(14, &info.bit_count, 2);
+		field(16, &info.compression, 4);
+		field(20, &info.image_size, 4);
+		field(24, &info.x_peels_per_meter, 4);
+		field(28, &info.y_peels_per_meter, 4);
+		field(32, &info.palette_colors, 4);
+		field(36, &info.important_colors, 4);
+
+		//os/2 2.x headers reuse the same leading fields but carry no masks
+		if (info.header_type == dib_header_type::bitmap_core_header2)
+			return info;
+
+		field(40, &info.red_mask, 4);
+		field(44, &info.green_mask, 4);
+		field(48, &info.blue_mask, 4);
+		field(52, &info.alpha_mask, 4);
+		field(56, &info.color_space, 4);
+		field(108, &info.intent, 4);
+		field(112, &info.profile_data, 4);
+		field(116, &info.profile_size, 4);
+		return info;
+	}
+
 	class dib_header
 	{
 	public:
@@ -249,7 +382,7 @@ namespace fbmp
 		if ( header_size <= 64 )
 			return std::unique_ptr<dib_header>(new dib_bitmap_Os22xBitmapHeader());
 		else
-			throw exception(std::string("Unsuppoerted bitmap dib header size - ") + std::to_string(static_cast<int>(header_type)));
+			throw exception(error_code::bad_header, std::string("Unsuppoerted bitmap dib header size - ") + std::to_string(static_cast<int>(header_type)));
 	}
 }
 
@@ -0,0 +1,699 @@
+
+#pragma once
+#ifndef FBMP_DECODE_KERNELS_H
+#define FBMP_DECODE_KERNELS_H
+
+//internal header: compile time specialised row kernels shared by the decoders
+
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <algorithm>
+
+#include "simd.h"
+#include "stream.h"
+#include "convert.h"
+#include "data_types.h"
+#include "decode_target.h"
+#include "decode_limits.h"
+#include "image_view.h"
+#include "image_ops.h"
+#include "hash.h"
+#include "stats.h"
+
+namespace fbmp
+{
+
+	struct bit_table
+	{
+		uint8_t indices[256][8];		//palette index of each pixel, most significant bit first
+		uint8_t black_white[256][8];	//the same pixels expanded to 0 / 255
+
+		constexpr bit_table()
+			: indices()
+			, black_white()
+		{
+			for (int value = 0; value < 256; ++value)
+			{
+				for (int k = 0; k < 8; ++k)
+				{
+					indices[value][k] = (uint8_t)((value >> (7 - k)) & 1);
+					black_white[value][k] = (uint8_t)(indices[value][k] * 255);
+				}
+			}
+		}
+	};
+
+	struct nibble_table
+	{
+		uint8_t indices[256][2];	//high nibble is the first pixel
+
+		constexpr nibble_table()
+			: indices()
+		{
+			for (int value = 0; value < 256; ++value)
+			{
+				indices[value][0] = (uint8_t)(value >> 4);
+				indices[value][1] = (uint8_t)(value & 0xF);
+			}
+		}
+	};
+
+	constexpr bit_table bit_lut;
+	constexpr nibble_table nibble_lut;
+
+	//header checks every decoder runs before it allocates anything, sizes are 64-bit
+	inline status check_header_limits(const bmp_info& info, const decode_limits& limits)
+	{
+		if (info.width <= 0 || info.height == 0 || info.height == INT32_MIN)
+			return status(error_code::bad_header, std::string("Invalid image size - ") + std::to_string(info.width) + "x" + std::to_string(info.height));
+
+		const uint64_t width = (uint64_t)info.width;
+		const uint64_t height = (uint64_t)info.abs_height();
+		if (width > limits.max_dimension || height > limits.max_dimension)
+			return status(error_code::limit_exceeded, std::string("Image size ") + std::to_string(width) + "x" + std::to_string(height) + " exceeds the dimension limit.");
+		if (width * height > limits.max_pixels)
+			return status(error_code::limit_exceeded, std::string("Image size ") + std::to_string(width) + "x" + std::to_string(height) + " exceeds the pixel limit.");
+
+		//the int32 row size used by the decoders must fit
+		if (info.row_bytes() > (uint64_t)INT32_MAX)
+			return status(error_code::limit_exceeded, "Image rows are too long.");
+		return status();
+	}
+
+	//only uncompressed rows are decoded, bitfields only when their masks are the plain BGRA byte order
+	inline status check_pixel_format(const bmp_info& info)
+	{
+		const int32_t bit_count = info.bit_count;
+		if (bit_count != 1 && bit_count != 4 && bit_count != 8 && bit_count != 24 && bit_count != 32)
+			return status(error_code::unsupported_format, std::string("not supported bpp ") + std::to_string(bit_count));
+
+		if (info.compression == 3 && bit_count == 32 && info.red_mask == 0x00FF0000 && info.green_mask == 0x0000FF00
+			&& info.blue_mask == 0x000000FF && (info.alpha_mask == 0 || info.alpha_mask == 0xFF000000))
+			return status();
+		if (info.compression == 3)
+			return status(error_code::unsupported_format, "Bitfield masks other than BGRA are not supported.");
+		if (info.compression != 0)
+			return status(error_code::unsupported_format, std::string("Compression ") + std::to_string(info.compression) + " is not supported.");
+		return status();
+	}
+
+	//the reserved byte of the entries is ignored
+	inline bool is_black_white(const uint32_t* palette)
+	{
+		return (palette[0] & 0xFFFFFF) == 0 && (palette[1] & 0xFFFFFF) == 0xFFFFFF;
+	}
+
+	//palette converted to R, G, B, 0 bytes, so one pixel is stored with a single 4 byte copy
+	struct palette_table
+	{
+		uint8_t rgb[256][4];
+
+		void assign(const uint32_t* palette)
+		{
+			for (int i = 0; i < 256; ++i)
+			{
+				rgb[i][0] = (uint8_t)(palette[i] >> 16);
+				rgb[i][1] = (uint8_t)(palette[i] >> 8);
+				rgb[i][2] = (uint8_t)palette[i];
+				rgb[i][3] = 0;
+			}
+		}
+	};
+
+	template <int BitCount, bool BlackWhite>
+	struct source_channels
+	{
+		enum { value = BitCount == 32 ? 4 : (BitCount == 1 && BlackWhite) ? 1 : 3 };
+	};
+
+	struct decode_geometry
+	{
+		int width;
+		int height;
+		int row_size;
+		uint64_t offset;
+	};
+
+	//output rows: where the channels of pixel x of a row go
+
+	template <int Channels>
+	struct interleaved_rows
+	{
+		static const bool interleaved = true;
+
+		uint8_t* data;
+		size_t pitch;
+		row_hash* hash;		//nullptr - rows are not hashed
+
+		uint8_t* row(int y) const { return data + pitch * y; }
+		void put(uint8_t* row, int x, const uint8_t* rgb) const { memcpy(row + x * Channels, rgb, 3); }
+		//writes one byte past the pixel, never used for the last pixel of a row
+		void put_wide(uint8_t* row, int x, const uint8_t* rgb) const { memcpy(row + x * Channels, rgb, 4); }
+		void finish(int y, uint8_t* row) const { hash_row(y, row); }
+		void hash_row(int y, const uint8_t* row) const
+		{
+			if (hash)
+				hash->add(y, row);
+		}
+	};
+
+	template <int Channels>
+	struct planar_rows
+	{
+		static const bool interleaved = false;
+
+		uint8_t* data;
+		size_t pitch;
+		size_t plane_stride;
+
+		uint8_t* row(int y) const { return data + pitch * y; }
+
+		void put(uint8_t* row, int x, const uint8_t* rgb) const
+		{
+			row[x] = rgb[0];
+			row[x + plane_stride] = rgb[1];
+			row[x + plane_stride * 2] = rgb[2];
+		}
+
+		void put_wide(uint8_t* row, int x, const uint8_t* rgb) const { put(row, x, rgb); }
+
+		void put_bgr(uint8_t* row, int x, const uint8_t* bgr) const
+		{
+			row[x] = bgr[2];
+			row[x + plane_stride] = bgr[1];
+			row[x + plane_stride * 2] = bgr[0];
+			if (Channels == 4)
+				row[x + plane_stride * 3] = bgr[3];
+		}
+
+		void finish(int, uint8_t*) const {}
+	};
+
+	struct stats_counter;
+
+	struct sample_rows
+	{
+		uint8_t* data;
+		size_t pitch;
+		size_t plane_stride;
+		sample_type type;
+		int width;
+		const float (*scale)[12];
+		const float (*bias)[12];
+		row_hash* hash;		//native rows before conversion, interleaved only
+		stats_counter* stats;
+		bool streaming;		//8-bit interleaved rows are written with non-temporal stores
+		bool scratch_padding;	//see reader::output_rows
+	};
+
+	template <int Channels>
+	inline void convert_row(const interleaved_rows<Channels>&, const sample_rows& target, int y, const uint8_t* scratch)
+	{
+		convert_samples(scratch, (size_t)target.width * Channels, target.data + target.pitch * y, target.type, target.scale[0], target.bias[0]);
+	}
+
+	template <int Channels>
+	inline void convert_row(const planar_rows<Channels>& rows, const sample_rows& target, int y, const uint8_t* scratch)
+	{
+		for (int c = 0; c < Channels; ++c)
+		{
+			uint8_t* dst = target.data + target.pitch * y + target.plane_stride * c;
+			convert_samples(scratch + rows.plane_stride * c, target.width, dst, target.type, target.scale[c], target.bias[c]);
+		}
+	}
+
+	//non 8-bit targets: every row is unpacked into one scratch row shaped like the target
+	//and converted to samples while it is still in cache
+	template <typename Rows>
+	struct converted_rows : Rows
+	{
+		sample_rows target;
+
+		uint8_t* row(int) const { return this->data; }
+		void finish(int y, uint8_t* scratch) const
+		{
+			if (Rows::interleaved)
+				Rows::finish(y, scratch);
+			convert_row(static_cast<const Rows&>(*this), target, y, scratch);
+		}
+	};
+
+	//copy that bypasses the cache for destinations that will not be read again soon
+	inline void stream_row(uint8_t* dst, const uint8_t* src, size_t size)
+	{
+		size_t i = 0;
+#if defined(FBMP_SSE2)
+		const size_t head = std::min(size, (size_t)((16 - ((uintptr_t)dst & 15)) & 15));
+		memcpy(dst, src, head);
+		for (i = head; i + 16 <= size; i += 16)
+			_mm_stream_si128(reinterpret_cast<__m128i*>(dst + i), _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i)));
+#endif
+		memcpy(dst + i, src + i, size - i);
+	}
+
+	//orders the streamed stores before anything that follows
+	inline void stream_fence()
+	{
+#if defined(FBMP_SSE2)
+		_mm_sfence();
+#endif
+	}
+
+	//8-bit interleaved targets of large images: rows are unpacked into an L1 resident scratch row
+	//and streamed to their destination, so the image does not evict the rest of the cache
+	template <typename Rows>
+	struct streamed_rows : Rows
+	{
+		uint8_t* target;
+		size_t target_pitch;
+		size_t row_bytes;
+
+		uint8_t* row(int) const { return this->data; }
+
+		void finish(int y, uint8_t* scratch) const
+		{
+			Rows::finish(y, scratch);
+			stream_row(target + target_pitch * y, scratch, row_bytes);
+		}
+	};
+
+	//rotated 8-bit targets: rows are decoded into a band and every complete band is rotated into place
+	template <int Channels>
+	struct rotated_rows : interleaved_rows<Channels>
+	{
+		image_view target;		//already rotated
+		rotation angle;
+		int height;
+		int band;
+		bool flipped;			//rows arrive bottom-up
+
+		uint8_t* row(int y) const { return this->data + this->pitch * (y % band); }
+
+		void finish(int y, uint8_t* row) const
+		{
+			this->hash_row(y, row);
+
+			const int first = y - y % band;
+			const int last = std::min(first + band, height) - 1;
+			if (y != (flipped ? first : last))
+				return;
+
+			const int rows = last - first + 1;
+			const size_t width = angle == rotation::rotate_180 ? target.width() : target.height();
+			const const_image_view source(this->data, width, rows, Channels, this->pitch);
+			switch (angle)
+			{
+			case rotation::rotate_90:
+				rotate(source, target.subview(height - 1 - last, 0, rows, width), angle);
+				break;
+			case rotation::rotate_270:
+				rotate(source, target.subview(first, 0, rows, width), angle);
+				break;
+			default:
+				rotate(source, target.subview(0, height - 1 - last, width, rows), angle);
+				break;
+			}
+		}
+	};
+
+	//BGR(A) -> RGB(A), src and dst may be the same row
+
+	template <int Channels>
+	inline void swizzle_row(const uint8_t* src, uint8_t* dst, int width);
+
+	//palette indices are kept as they are
+	template <>
+	inline void swizzle_row<1>(const uint8_t* src, uint8_t* dst, int width)
+	{
+		if (src != dst)
+			memmove(dst, src, width);
+	}
+
+	template <>
+	inline void swizzle_row<3>(const uint8_t* src, uint8_t* dst, int width)
+	{
+		const size_t size = (size_t)width * 3;
+		size_t i = 0;
+
+#if defined(FBMP_SSSE3)
+		//5 pixels per step, the 16th byte is stored unchanged and rewritten by the next step
+		const __m128i mask = _mm_setr_epi8(2, 1, 0, 5, 4, 3, 8, 7, 6, 11, 10, 9, 14, 13, 12, 15);
+		for (; i + 16 <= size; i += 15)
+		{
+			const __m128i value = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_shuffle_epi8(value, mask));
+		}
+#endif
+
+		for (; i < size; i += 3)
+		{
+			const uint8_t b = src[i];
+			dst[i] = src[i + 2];
+			dst[i + 1] = src[i + 1];
+			dst[i + 2] = b;
+		}
+	}
+
+	template <>
+	inline void swizzle_row<4>(const uint8_t* src, uint8_t* dst, int width)
+	{
+		const size_t size = (size_t)width * 4;
+		size_t i = 0;
+
+#if defined(FBMP_SSSE3)
+		const __m128i mask = _mm_setr_epi8(2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15);
+		for (; i + 16 <= size; i += 16)
+		{
+			const __m128i value = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_shuffle_epi8(value, mask));
+		}
+#elif defined(FBMP_SSE2)
+		const __m128i green_alpha = _mm_set1_epi32((int)0xFF00FF00);
+		for (; i + 16 <= size; i += 16)
+		{
+			const __m128i value = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+			const __m128i red_blue = _mm_andnot_si128(green_alpha, value);
+			const __m128i swapped = _mm_or_si128(_mm_slli_epi32(red_blue, 16), _mm_srli_epi32(red_blue, 16));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_or_si128(_mm_and_si128(value, green_alpha), swapped));
+		}
+#endif
+
+		for (; i < size; i += 4)
+		{
+			const uint8_t b = src[i];
+			dst[i] = src[i + 2];
+			dst[i + 1] = src[i + 1];
+			dst[i + 2] = b;
+			dst[i + 3] = src[i + 3];
+		}
+	}
+
+	//row kernels
+
+	template <int BitCount>
+	inline uint8_t pixel_index(const uint8_t* line, int x)
+	{
+		return BitCount == 8 ? line[x]
+			: BitCount == 4 ? nibble_lut.indices[line[x >> 1]][x & 1]
+			: bit_lut.indices[line[x >> 3]][x & 7];
+	}
+
+	//histograms gathered from file rows before they are unpacked, palette formats count
+	//whole bytes and map them to indices and colors once at the end
+	//neighbouring bytes and pixels go to separate copies so repeated values do not wait for each other
+	struct stats_counter
+	{
+		uint64_t bytes[4][256];			//whole bytes of 1, 4 and 8bpp rows
+		uint64_t indices[256];			//pixels of the last partial byte of 1 and 4bpp rows
+		uint64_t samples[2][4][256];	//B, G, R, A of 24 and 32bpp rows
+
+		stats_counter()
+		{
+			memset(this, 0, sizeof(*this));
+		}
+
+		template <int BitCount>
+		void count(const uint8_t* line, int width)
+		{
+			if (BitCount <= 8)
+			{
+				const int per_byte = 8 / (BitCount <= 8 ? BitCount : 8);
+				const int whole = width / per_byte;
+				int i = 0;
+				for (; i + 4 <= whole; i += 4)
+				{
+					++bytes[0][line[i]];
+					++bytes[1][line[i + 1]];
+					++bytes[2][line[i + 2]];
+					++bytes[3][line[i + 3]];
+				}
+				for (; i < whole; ++i)
+					++bytes[0][line[i]];
+				for (int x = whole * per_byte; x < width; ++x)
+					++indices[pixel_index<BitCount <= 8 ? BitCount : 8>(line, x)];
+				return;
+			}
+
+			const int channels = BitCount / 8;
+			int x = 0;
+			for (; x + 2 <= width; x += 2, line += channels * 2)
+			{
+				for (int c = 0; c < channels; ++c)
+				{
+					++samples[0][c][line[c]];
+					++samples[1][c][line[channels + c]];
+				}
+			}
+			for (int c = 0; x < width && c < channels; ++c)
+				++samples[0][c][line[c]];
+		}
+
+		void count(int bit_count, const uint8_t* line, int width)
+		{
+			switch (bit_count)
+			{
+			case 1: count<1>(line, width); break;
+			case 4: count<4>(line, width); break;
+			case 8: count<8>(line, width); break;
+			case 24: count<24>(line, width); break;
+			case 32: count<32>(line, width); break;
+			}
+		}
+
+		image_stats finish(int bit_count, size_t channels, uint64_t pixels, const palette_table& palette) const
+		{
+			image_stats stats;
+			stats.channels = channels;
+			stats.pixels = pixels;
+
+			if (bit_count <= 8)
+			{
+				uint64_t counts[256];
+				memcpy(counts, indices, sizeof(counts));
+				for (int b = 0; b < 256; ++b)
+				{
+					const uint64_t count = bytes[0][b] + bytes[1][b] + bytes[2][b] + bytes[3][b];
+					if (!count)
+						continue;
+					for (int x = 0; x < 8 / bit_count; ++x)
+					{
+						const uint8_t index = bit_count == 8 ? (uint8_t)b : bit_count == 4 ? nibble_lut.indices[b][x] : bit_lut.indices[b][x];
+						counts[index] += count;
+					}
+				}
+
+				for (int i = 0; i < 256; ++i)
+				{
+					for (size_t c = 0; c < channels && counts[i]; ++c)
+						stats.histogram[c][palette.rgb[i][c]] += counts[i];
+				}
+			}
+			else
+			{
+				//file order is B, G, R, A
+				static const int source[4] = { 2, 1, 0, 3 };
+				for (size_t c = 0; c < channels; ++c)
+				{
+					for (int v = 0; v < 256; ++v)
+						stats.histogram[c][v] = samples[0][source[c]][v] + samples[1][source[c]][v];
+				}
+			}
+
+			stats.summarize();
+			return stats;
+		}
+	};
+
+	template <int BitCount>
+	inline void unpack_indices(const uint8_t* line, uint8_t* indices, int width)
+	{
+		int x = 0;
+		if (BitCount == 8)
+		{
+			memcpy(indices, line, width);
+			return;
+		}
+		else if (BitCount == 4)
+		{
+			for (; x + 2 <= width; x += 2)
+				memcpy(indices + x, nibble_lut.indices[line[x >> 1]], 2);
+		}
+		else
+		{
+			for (; x + 8 <= width; x += 8)
+				memcpy(indices + x, bit_lut.indices[line[x >> 3]], 8);
+		}
+		for (; x < width; ++x)
+			indices[x] = pixel_index<BitCount>(line, x);
+	}
+
+	inline void unpack_black_white_row(const uint8_t* line, uint8_t* row, int width)
+	{
+		int x = 0;
+		for (; x + 8 <= width; x += 8)
+			memcpy(row + x, bit_lut.black_white[line[x >> 3]], 8);
+		for (; x < width; ++x)
+			row[x] = bit_lut.black_white[line[x >> 3]][x & 7];
+	}
+
+	template <int BitCount, typename Rows>
+	inline void unpack_palette_row(const uint8_t* line, uint8_t* row, int width, const Rows& rows, const palette_table& palette)
+	{
+		int x = 0;
+		if (BitCount == 8)
+		{
+			for (; x + 1 < width; ++x)
+				rows.put_wide(row, x, palette.rgb[line[x]]);
+		}
+		else if (BitCount == 4)
+		{
+			for (; x + 2 < width; x += 2)
+			{
+				const uint8_t* indices = nibble_lut.indices[line[x >> 1]];
+				rows.put_wide(row, x, palette.rgb[indices[0]]);
+				rows.put_wide(row, x + 1, palette.rgb[indices[1]]);
+			}
+		}
+		else
+		{
+			for (; x + 8 < width; x += 8)
+			{
+				const uint8_t* indices = bit_lut.indices[line[x >> 3]];
+				for (int k = 0; k < 8; ++k)
+					rows.put_wide(row, x + k, palette.rgb[indices[k]]);
+			}
+		}
+
+		for (; x < width; ++x)
+			rows.put(row, x, palette.rgb[pixel_index<BitCount>(line, x)]);
+	}
+
+	template <int Channels>
+	inline void unpack_direct_row(const uint8_t* line, uint8_t* row, int width, const interleaved_rows<Channels>&)
+	{
+		swizzle_row<Channels>(line, row, width);
+	}
+
+	template <int Channels>
+	inline void unpack_direct_row(const uint8_t* line, uint8_t* row, int width, const planar_rows<Channels>& rows)
+	{
+		for (int x = 0; x < width; ++x, line += Channels)
+			rows.put_bgr(row, x, line);
+	}
+
+	//single channel rows only come from black / white sources
+	inline void unpack_direct_row(const uint8_t*, uint8_t*, int, const interleaved_rows<1>&)
+	{}
+
+	//the branches are resolved at compile time, the unused ones are instantiated with valid dummy parameters
+	template <int BitCount, bool BlackWhite, typename Rows>
+	inline void unpack_row(const uint8_t* line, uint8_t* row, int width, const Rows& rows, const palette_table& palette)
+	{
+		if (BitCount == 1 && BlackWhite)
+			unpack_black_white_row(line, row, width);
+		else if (BitCount <= 8)
+			unpack_palette_row<BitCount <= 8 ? BitCount : 8>(line, row, width, rows, palette);
+		else
+			unpack_direct_row(line, row, width, rows);
+	}
+
+	template <int BitCount, bool BlackWhite, bool Flipped, typename Rows>
+	void decode_rows(input_stream& stream, const decode_geometry& g, const Rows& rows, const palette_table& palette, stats_counter* stats = nullptr)
+	{
+		stream.seek(g.offset);
+		std::unique_ptr<uint8_t[]> line_buffer(new uint8_t[g.row_size]);
+
+		for (int i = 0; i < g.height; ++i)
+		{
+			const int y = Flipped ? g.height - 1 - i : i;
+			stream.read(line_buffer.get(), sizeof(uint8_t), g.row_size);
+			if (stats)
+				stats->count<BitCount>(line_buffer.get(), g.width);
+			uint8_t* row = rows.row(y);
+			unpack_row<BitCount, BlackWhite>(line_buffer.get(), row, g.width, rows, palette);
+			rows.finish(y, row);
+		}
+	}
+
+	//24/32bpp into interleaved rows whose pitch is the file row size: rows are read straight
+	//into their destination and swizzled while they are still in cache, no line buffer
+	template <int Channels, bool Flipped>
+	void decode_in_place(input_stream& stream, const decode_geometry& g, uint8_t* data, size_t pitch, row_hash* hash, stats_counter* stats = nullptr)
+	{
+		stream.seek(g.offset);
+
+		//rows are contiguous: read blocks of rows with one call, a bottom-up block lands on its
+		//mirrored destination and is turned upside down while it is swizzled
+		const int block = std::max(1, (256 * 1024) / g.row_size);
+		std::unique_ptr<uint8_t[]> row_buffer(Flipped ? new uint8_t[g.row_size] : nullptr);
+
+		for (int i = 0; i < g.height; i += block)
+		{
+			const int count = std::min(block, g.height - i);
+			const int first_y = Flipped ? g.height - i - count : i;
+			uint8_t* first = data + pitch * first_y;
+			stream.read(first, sizeof(uint8_t), (size_t)g.row_size * count);
+			for (int k = 0; stats && k < count; ++k)
+				stats->count<Channels * 8>(first + pitch * k, g.width);
+
+			if (Flipped)
+			{
+				for (int top = 0, bottom = count - 1; top <= bottom; ++top, --bottom)
+				{
+					uint8_t* a = first + pitch * top;
+					uint8_t* b = first + pitch * bottom;
+					if (a == b)
+					{
+						swizzle_row<Channels>(a, a, g.width);
+						break;
+					}
+					memcpy(row_buffer.get(), a, g.row_size);
+					swizzle_row<Channels>(b, a, g.width);
+					swizzle_row<Channels>(row_buffer.get(), b, g.width);
+				}
+			}
+			else
+			{
+				for (int k = 0; k < count; ++k)
+					swizzle_row<Channels>(first + pitch * k, first + pitch * k, g.width);
+			}
+
+			//the block is still in cache
+			for (int k = 0; hash && k < count; ++k)
+				hash->add(first_y + k, first + pitch * k);
+		}
+	}
+
+	//decodes one row of any supported format into interleaved native channels
+	typedef void (*row_kernel)(const uint8_t* line, uint8_t* row, int width, const palette_table& palette);
+
+	template <int BitCount, bool BlackWhite>
+	void interleaved_row_kernel(const uint8_t* line, uint8_t* row, int width, const palette_table& palette)
+	{
+		const interleaved_rows<source_channels<BitCount, BlackWhite>::value> rows = { nullptr, 0, nullptr };
+		unpack_row<BitCount, BlackWhite>(line, row, width, rows, palette);
+	}
+
+	inline row_kernel select_row_kernel(int bit_count, bool black_white)
+	{
+		switch (bit_count)
+		{
+		case 1:
+			return black_white ? interleaved_row_kernel<1, true> : interleaved_row_kernel<1, false>;
+		case 4:
+			return interleaved_row_kernel<4, false>;
+		case 8:
+			return interleaved_row_kernel<8, false>;
+		case 24:
+			return interleaved_row_kernel<24, false>;
+		case 32:
+			return interleaved_row_kernel<32, false>;
+		default:
+			return nullptr;
+		}
+	}
+
+}
+
+#endif //FBMP_DECODE_KERNELS_H
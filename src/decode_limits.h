@@ -0,0 +1,110 @@
+
+#pragma once
+#ifndef FBMP_DECODE_LIMITS_H
+#define FBMP_DECODE_LIMITS_H
+
+#include <cstdint>
+#include <atomic>
+
+namespace fbmp
+{
+
+	//bytes shared by every reader that points at it, safe to use from several threads
+	class memory_budget
+	{
+	public:
+		explicit memory_budget(uint64_t capacity)
+			: m_capacity(capacity)
+			, m_used(0)
+		{}
+
+		memory_budget(const memory_budget&) = delete;
+		memory_budget& operator=(const memory_budget&) = delete;
+
+		//false leaves the budget untouched
+		bool try_acquire(uint64_t bytes)
+		{
+			uint64_t used = m_used.load();
+			do
+			{
+				if (bytes > m_capacity - used)
+					return false;
+			} while (!m_used.compare_exchange_weak(used, used + bytes));
+			return true;
+		}
+
+		void release(uint64_t bytes) { m_used -= bytes; }
+
+		uint64_t capacity() const { return m_capacity; }
+		uint64_t used() const { return m_used.load(); }
+
+	private:
+		const uint64_t m_capacity;
+		std::atomic<uint64_t> m_used;
+	};
+
+	//checked against the headers before anything is allocated or decoded
+	//nothing is limited by default, callers decoding files they do not trust opt in, e.g. with untrusted()
+	struct decode_limits
+	{
+		uint32_t max_dimension = 0x7FFFFFFF;	//width and height
+		uint64_t max_pixels = UINT64_MAX;		//width * height
+		uint64_t max_bytes = UINT64_MAX;		//image allocated by the reader
+		memory_budget* budget = nullptr;		//images allocated by all readers sharing it, nullptr - no shared limit
+
+		static decode_limits unlimited()
+		{
+			return decode_limits();
+		}
+
+		//at most 1M pixels a side, 256M pixels and 1 GiB of decoded image
+		static decode_limits untrusted()
+		{
+			decode_limits limits;
+			limits.max_dimension = 1 << 20;
+			limits.max_pixels = 1ull << 28;
+			limits.max_bytes = 1ull << 30;
+			return limits;
+		}
+	};
+
+	//bytes held in a memory_budget, given back on destruction
+	class budget_reservation
+	{
+	public:
+		budget_reservation() = default;
+
+		budget_reservation(const budget_reservation&) = delete;
+		budget_reservation& operator=(const budget_reservation&) = delete;
+
+		~budget_reservation()
+		{
+			release();
+		}
+
+		bool acquire(memory_budget* budget, uint64_t bytes)
+		{
+			release();
+			if (budget && !budget->try_acquire(bytes))
+				return false;
+			m_budget = budget;
+			m_bytes = bytes;
+			return true;
+		}
+
+		void release()
+		{
+			if (m_budget)
+				m_budget->release(m_bytes);
+			m_budget = nullptr;
+			m_bytes = 0;
+		}
+
+	private:
+		memory_budget* m_budget = nullptr;
+		uint64_t m_bytes = 0;
+	};
+
+}
+
+#endif //FBMP_DECODE_LIMITS_H
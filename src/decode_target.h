@@ -0,0 +1,160 @@
+
+#pragma once
+#ifndef FBMP_DECODE_TARGET_H
+#define FBMP_DECODE_TARGET_H
+
+#include <cstdint>
+#include <cstddef>
+
+namespace fbmp
+{
+
+	enum class pixel_layout
+	{
+		interleaved,	//HWC - channels of one pixel are adjacent
+		planar			//CHW - every channel is stored in its own plane
+	};
+
+	enum class sample_type
+	{
+		u8,		//raw 8-bit values, no normalization
+		f32,
+		f16,	//IEEE half precision
+		bf16	//bfloat16
+	};
+
+	inline size_t sample_size(sample_type type)
+	{
+		return type == sample_type::u8 ? 1 : type == sample_type::f32 ? 4 : 2;
+	}
+
+	enum class pixel_format
+	{
+		native,	//what the file holds - gray for black/white 1bpp, RGB, or RGBA for 32bpp
+		gray,	//full range 8-bit luma
+		i420,	//limited range Y plane, then U and V planes at half resolution
+		nv12,	//limited range Y plane, then one interleaved UV plane at half resolution
+		indexed	//one byte per pixel holding the palette index, 1, 4 and 8bpp files only
+	};
+
+	enum class color_matrix
+	{
+		bt601,
+		bt709
+	};
+
+	enum class rotation
+	{
+		none,
+		rotate_90,		//clockwise
+		rotate_180,
+		rotate_270
+	};
+
+	enum class row_order
+	{
+		keep,		//as stored in the file
+		top_down,
+		bottom_up
+	};
+
+	//caller owned memory the reader decodes into
+	//channels are always ordered R, G, B, A in both layouts
+	//floating point samples are stored as (x / 255 - mean[c]) / stddev[c]
+	struct decode_target
+	{
+		uint8_t* data = nullptr;
+		pixel_layout layout = pixel_layout::interleaved;
+		size_t pitch = 0;			//bytes between rows, 0 - rows are tightly packed
+		size_t plane_stride = 0;	//bytes between planes (planar only), 0 - pitch * height
+
+		sample_type type = sample_type::u8;
+		float mean[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+		float stddev[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+
+		//gray and YUV output, data and pitch describe the luma plane
+		//chroma rows hold (width + 1) / 2 samples per plane and there are (height + 1) / 2 of them
+		pixel_format format = pixel_format::native;
+		color_matrix matrix = color_matrix::bt601;
+		uint8_t* chroma[2] = { nullptr, nullptr };	//U and V planes (i420) or the UV plane (nv12), nullptr - right after the previous plane
+		size_t chroma_pitch = 0;					//0 - rows are tightly packed
+
+		//applied while decoding, interleaved 8-bit native output only
+		//width and height of the target are swapped for 90 and 270 degrees
+		rotation rotate = rotation::none;
+
+		//indexed output of a gray palette (r == g == b in every entry) holds the gray values instead of the indices
+		bool palette_gray = false;
+
+		inline static decode_target interleaved(uint8_t* data, size_t pitch = 0);
+		inline static decode_target planar(uint8_t* data, size_t pitch = 0, size_t plane_stride = 0);
+		inline static decode_target gray(uint8_t* data, size_t pitch = 0, color_matrix matrix = color_matrix::bt601);
+		inline static decode_target yuv(pixel_format format, uint8_t* data, size_t pitch = 0, color_matrix matrix = color_matrix::bt601);
+		inline static decode_target indexed(uint8_t* data, size_t pitch = 0, bool palette_gray = false);
+
+		inline decode_target& normalize(sample_type type, const float* mean = nullptr, const float* stddev = nullptr, size_t channels = 3);
+	};
+
+	inline decode_target decode_target::interleaved(uint8_t* data, size_t pitch)
+	{
+		decode_target target;
+		target.data = data;
+		target.layout = pixel_layout::interleaved;
+		target.pitch = pitch;
+		return target;
+	}
+
+	inline decode_target decode_target::planar(uint8_t* data, size_t pitch, size_t plane_stride)
+	{
+		decode_target target;
+		target.data = data;
+		target.layout = pixel_layout::planar;
+		target.pitch = pitch;
+		target.plane_stride = plane_stride;
+		return target;
+	}
+
+	inline decode_target decode_target::gray(uint8_t* data, size_t pitch, color_matrix matrix)
+	{
+		decode_target target;
+		target.data = data;
+		target.pitch = pitch;
+		target.format = pixel_format::gray;
+		target.matrix = matrix;
+		return target;
+	}
+
+	inline decode_target decode_target::yuv(pixel_format format, uint8_t* data, size_t pitch, color_matrix matrix)
+	{
+		decode_target target;
+		target.data = data;
+		target.pitch = pitch;
+		target.format = format;
+		target.matrix = matrix;
+		return target;
+	}
+
+	inline decode_target decode_target::indexed(uint8_t* data, size_t pitch, bool palette_gray)
+	{
+		decode_target target;
+		target.data = data;
+		target.pitch = pitch;
+		target.format = pixel_format::indexed;
+		target.palette_gray = palette_gray;
+		return target;
+	}
+
+	inline decode_target& decode_target::normalize(sample_type type, const float* mean, const float* stddev, size_t channels)
+	{
+		this->type = type;
+		for (size_t c = 0; c < 4; ++c)
+		{
+			this->mean[c] = mean && c < channels ? mean[c] : 0.0f;
+			this->stddev[c] = stddev && c < channels ? stddev[c] : 1.0f;
+		}
+		return *this;
+	}
+
+}
+
+#endif //FBMP_DECODE_TARGET_H
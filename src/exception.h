@@ -4,24 +4,46 @@
 #define FBMP_EXCEPTION_H
 
 #include <string>
+#include <stdexcept>
+
+#include "status.h"
 
 namespace fbmp
 {
 
-	class exception : public std::exception
+	class exception : public std::runtime_error
 	{
 	public:
-		exception() = default;
+		exception()
+			: exception(error_code::unknown, "fbmp error")
+		{}
 
-		exception(const char* const& msg)
-			: std::exception(msg)
+		exception(const char* msg)
+			: exception(error_code::unknown, msg)
 		{}
 
 		exception(const std::string& msg)
-			: std::exception(msg.c_str())
+			: exception(error_code::unknown, msg)
+		{}
+
+		exception(error_code code, const std::string& msg)
+			: std::runtime_error(msg)
+			, _code(code)
 		{}
+
+		error_code code() const { return _code; }
+
+	private:
+		error_code _code;
 	};
 
+	//the exception API on top of the status one
+	inline void throw_if_error(const status& result)
+	{
+		if (!result.ok())
+			throw exception(result.code(), result.message());
+	}
+
 }
 
 #endif //FBMP_EXCEPTION_H
@@ -4,7 +4,18 @@
 #define FAST_BMP_H
 
 #include "file_stream.h"
+#include "memory_stream.h"
+#include "image_view.h"
 #include "reader.h"
+#include "push_decoder.h"
 #include "writer.h"
+#include "transcoder.h"
+#include "batch.h"
+#include "hash.h"
+#include "stats.h"
+#include "image_ops.h"
+#include "large_alloc.h"
+#include "shared_image.h"
+#include "pack.h"
 
 #endif //FAST_BMP_H
@@ -4,6 +4,15 @@
 #define FBMP_FILE_STREAM_H
 
 #include <cstdio>
+#include <cstdint>
+#include <mutex>
+#if defined(_WIN32)
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#endif
 #include "exception.h"
 #include "stream.h"
 
@@ -41,10 +50,16 @@ namespace fbmp
 		}
 
 		void open_for_reading() override
+		{
+			throw_if_error(try_open_for_reading());
+		}
+
+		status try_open_for_reading() noexcept override
 		{
 			if (m_file != nullptr)
 			{
-				seek(0);
+				if (!seek_to(0))
+					return status(error_code::read_failed, std::string("Can not seek to 0 in file: {") + m_fileName + "}.");
 			}
 			else
 			{
@@ -52,9 +67,10 @@ namespace fbmp
 
 				if (m_file == nullptr)
 				{
-					throw exception( std::string("Can not open file: {") + m_fileName + "} for reading.");
+					return status(error_code::open_failed, std::string("Can not open file: {") + m_fileName + "} for reading.");
 				}
 			}
+			return status();
 		}
 
 		void close() override
@@ -70,20 +86,51 @@ namespace fbmp
 		{
 			size_t readed = fread(buffer, element_size, count, m_file);
 			if (readed != count)
-				throw exception("can not read expected size of data");
+				throw exception(error_code::read_failed, "can not read expected size of data");
+		}
+
+		status try_read(void* buffer, size_t element_size, size_t count) noexcept override
+		{
+			size_t readed = fread(buffer, element_size, count, m_file);
+			if (readed != count)
+				return status(error_code::read_failed, "can not read expected size of data");
+			return status();
 		}
 
-		void seek(int pos) override
+		void seek(uint64_t pos) override
 		{
-			fseek(m_file, pos, SEEK_SET);
+			if (!seek_to(pos))
+				throw exception(error_code::read_failed, std::string("Can not seek to ") + std::to_string(pos) + " in file: {" + m_fileName + "}.");
+		}
+
+		uint64_t size() override
+		{
+			if (m_file == nullptr)
+				return 0;
+#if defined(_WIN32)
+			const __int64 length = _filelengthi64(_fileno(m_file));
+			return length < 0 ? 0 : (uint64_t)length;
+#else
+			struct stat info;
+			return fstat(fileno(m_file), &info) != 0 ? 0 : (uint64_t)info.st_size;
+#endif
 		}
 
 	private:
+		bool seek_to(uint64_t pos) noexcept
+		{
+#if defined(_WIN32)
+			return _fseeki64(m_file, (__int64)pos, SEEK_SET) == 0;
+#else
+			return fseeko(m_file, (off_t)pos, SEEK_SET) == 0;
+#endif
+		}
+
 		FILE* m_file = nullptr;
-		std::string m_fileName = nullptr;
+		std::string m_fileName;
 	};
 
-	class file_output_stream : public output_stream
+	class file_output_stream : public positional_output_stream
 	{
 	public:
 		file_output_stream()
@@ -113,7 +160,7 @@ namespace fbmp
 
 			if (m_file == nullptr)
 			{
-				throw exception();
+				throw exception(error_code::open_failed, std::string("Can not open file: {") + (m_fileName ? m_fileName : "") + "} for writing.");
 			}
 		}
 
@@ -131,13 +178,58 @@ namespace fbmp
 			size_t written = fwrite(buffer, element_size, count, m_file);
 			if (written != count)
 			{
-				throw exception("Can not write expected size of data");
+				throw exception(error_code::write_failed, "Can not write expected size of data");
+			}
+		}
+
+		void reserve(uint64_t size) override
+		{
+			fflush(m_file);
+#if defined(_WIN32)
+			if (_chsize_s(_fileno(m_file), (__int64)size) != 0)
+#elif defined(__linux__)
+			if (posix_fallocate(fileno(m_file), 0, (off_t)size) != 0)
+#else
+			if (ftruncate(fileno(m_file), (off_t)size) != 0)
+#endif
+			{
+				throw exception(error_code::write_failed, "Can not reserve file space");
+			}
+		}
+
+		//bypasses the stdio buffer, do not mix with buffered writes to the same range
+		void write_at(uint64_t offset, const void* buffer, size_t size) override
+		{
+#if defined(_WIN32)
+			std::lock_guard<std::mutex> lock(m_positionMutex);
+			fflush(m_file);
+			if (_fseeki64(m_file, (__int64)offset, SEEK_SET) != 0 || fwrite(buffer, 1, size, m_file) != size)
+			{
+				throw exception(error_code::write_failed, "Can not write expected size of data");
+			}
+#else
+			const int fd = fileno(m_file);
+			const char* data = static_cast<const char*>(buffer);
+			while (size > 0)
+			{
+				const ssize_t written = pwrite(fd, data, size, (off_t)offset);
+				if (written <= 0)
+				{
+					throw exception(error_code::write_failed, "Can not write expected size of data");
+				}
+				data += written;
+				offset += written;
+				size -= written;
 			}
+#endif
 		}
 
 	private:
 		FILE* m_file;
 		const char* m_fileName;
+#if defined(_WIN32)
+		std::mutex m_positionMutex;
+#endif
 	};
 
 }
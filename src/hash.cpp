@@ -0,0 +1,178 @@
+
+#include <cstring>
+#include <algorithm>
+#include "hash.h"
+
+namespace fbmp
+{
+
+	namespace
+	{
+		const uint64_t prime1 = 11400714785074694791ull;
+		const uint64_t prime2 = 14029467366897019727ull;
+		const uint64_t prime3 = 1609587929392839161ull;
+		const uint64_t prime4 = 9650029242287828579ull;
+		const uint64_t prime5 = 2870177450012600261ull;
+
+		inline uint64_t rotl(uint64_t value, int bits)
+		{
+			return (value << bits) | (value >> (64 - bits));
+		}
+
+		//little endian loads, as the reference implementation reads them
+		inline uint64_t load64(const uint8_t* p)
+		{
+			uint64_t value;
+			memcpy(&value, p, sizeof(value));
+			return value;
+		}
+
+		inline uint32_t load32(const uint8_t* p)
+		{
+			uint32_t value;
+			memcpy(&value, p, sizeof(value));
+			return value;
+		}
+
+		inline uint64_t round_lane(uint64_t lane, uint64_t input)
+		{
+			lane += input * prime2;
+			lane = rotl(lane, 31);
+			return lane * prime1;
+		}
+
+		inline uint64_t merge(uint64_t hash, uint64_t lane)
+		{
+			hash ^= round_lane(0, lane);
+			return hash * prime1 + prime4;
+		}
+
+		//32 byte stripes
+		inline const uint8_t* consume(uint64_t* lanes, const uint8_t* p, const uint8_t* end)
+		{
+			uint64_t l0 = lanes[0], l1 = lanes[1], l2 = lanes[2], l3 = lanes[3];
+			for (; p + 32 <= end; p += 32)
+			{
+				l0 = round_lane(l0, load64(p));
+				l1 = round_lane(l1, load64(p + 8));
+				l2 = round_lane(l2, load64(p + 16));
+				l3 = round_lane(l3, load64(p + 24));
+			}
+			lanes[0] = l0; lanes[1] = l1; lanes[2] = l2; lanes[3] = l3;
+			return p;
+		}
+
+		//the last total % 32 bytes and the avalanche
+		uint64_t finish(uint64_t hash, const uint8_t* p, size_t size)
+		{
+			for (; size >= 8; size -= 8, p += 8)
+			{
+				hash ^= round_lane(0, load64(p));
+				hash = rotl(hash, 27) * prime1 + prime4;
+			}
+			if (size >= 4)
+			{
+				hash ^= (uint64_t)load32(p) * prime1;
+				hash = rotl(hash, 23) * prime2 + prime3;
+				size -= 4;
+				p += 4;
+			}
+			for (; size > 0; --size, ++p)
+			{
+				hash ^= *p * prime5;
+				hash = rotl(hash, 11) * prime1;
+			}
+
+			hash ^= hash >> 33;
+			hash *= prime2;
+			hash ^= hash >> 29;
+			hash *= prime3;
+			hash ^= hash >> 32;
+			return hash;
+		}
+
+		uint64_t converge(const uint64_t* lanes)
+		{
+			uint64_t hash = rotl(lanes[0], 1) + rotl(lanes[1], 7) + rotl(lanes[2], 12) + rotl(lanes[3], 18);
+			for (int i = 0; i < 4; ++i)
+				hash = merge(hash, lanes[i]);
+			return hash;
+		}
+	}
+
+	uint64_t xxh64(const void* data, size_t size, uint64_t seed)
+	{
+		const uint8_t* p = static_cast<const uint8_t*>(data);
+		const uint8_t* end = p + size;
+
+		uint64_t hash;
+		if (size >= 32)
+		{
+			uint64_t lanes[4] = { seed + prime1 + prime2, seed + prime2, seed, seed - prime1 };
+			p = consume(lanes, p, end);
+			hash = converge(lanes);
+		}
+		else
+		{
+			hash = seed + prime5;
+		}
+
+		return finish(hash + size, p, (size_t)(end - p));
+	}
+
+	xxh64_state::xxh64_state(uint64_t seed)
+		: _seed(seed)
+		, _total(0)
+		, _buffered(0)
+	{
+		_lanes[0] = seed + prime1 + prime2;
+		_lanes[1] = seed + prime2;
+		_lanes[2] = seed;
+		_lanes[3] = seed - prime1;
+	}
+
+	void xxh64_state::update(const void* data, size_t size)
+	{
+		const uint8_t* p = static_cast<const uint8_t*>(data);
+		const uint8_t* end = p + size;
+		_total += size;
+
+		if (_buffered)
+		{
+			const size_t count = std::min(size, sizeof(_buffer) - _buffered);
+			memcpy(_buffer + _buffered, p, count);
+			_buffered += count;
+			p += count;
+			if (_buffered < sizeof(_buffer))
+				return;
+			consume(_lanes, _buffer, _buffer + sizeof(_buffer));
+			_buffered = 0;
+		}
+
+		p = consume(_lanes, p, end);
+		_buffered = (size_t)(end - p);
+		memcpy(_buffer, p, _buffered);
+	}
+
+	uint64_t xxh64_state::digest() const
+	{
+		const uint64_t hash = _total >= 32 ? converge(_lanes) : _seed + prime5;
+		return finish(hash + _total, _buffer, _buffered);
+	}
+
+	uint64_t row_hash::digest(size_t width, size_t height, size_t channels) const
+	{
+		const uint64_t shape[4] = { width, height, channels, sum };
+		return xxh64(shape, sizeof(shape));
+	}
+
+	uint64_t content_hash(const const_image_view& img)
+	{
+		row_hash hash;
+		hash.row_bytes = img.width() * img.channels();
+		for (size_t y = 0; y < img.height(); ++y)
+			hash.add((int)y, img.get_row_begin(y));
+		return hash.digest(img.width(), img.height(), img.channels());
+	}
+
+}
@@ -0,0 +1,104 @@
+
+#pragma once
+#ifndef FBMP_HASH_H
+#define FBMP_HASH_H
+
+#include <cstdint>
+#include <cstddef>
+
+#include "stream.h"
+#include "image_view.h"
+
+namespace fbmp
+{
+
+	//XXH64, fast non-cryptographic hash
+	uint64_t xxh64(const void* data, size_t size, uint64_t seed = 0);
+
+	//XXH64 of data given in pieces, same result as one xxh64 call over all of them
+	class xxh64_state
+	{
+	public:
+		explicit xxh64_state(uint64_t seed = 0);
+
+		void update(const void* data, size_t size);
+		uint64_t digest() const;
+
+	private:
+		uint64_t _seed;
+		uint64_t _lanes[4];
+		uint64_t _total;
+		uint8_t _buffer[32];
+		size_t _buffered;
+	};
+
+	//hash of decoded pixels that does not depend on the order rows are added in
+	//every row is hashed with its y as the seed, the row hashes are summed and the sum is hashed with the shape
+	struct row_hash
+	{
+		size_t row_bytes = 0;	//width * channels
+		uint64_t sum = 0;
+
+		void add(int y, const uint8_t* row) { sum += xxh64(row, row_bytes, (uint64_t)y); }
+		uint64_t digest(size_t width, size_t height, size_t channels) const;
+	};
+
+	//the content hash the reader computes while it decodes, for 8-bit images from any other source
+	uint64_t content_hash(const const_image_view& img);
+
+	//input stream that hashes every byte read through it, in the order it is read
+	//skipped bytes are not part of the hash, the reader skips nothing for files without a gap before the pixels
+	class hashing_input_stream : public input_stream
+	{
+	public:
+		hashing_input_stream(input_stream& source, uint64_t seed = 0)
+			: m_source(source)
+			, m_seed(seed)
+			, m_state(seed)
+		{}
+
+		void open_for_reading() override
+		{
+			m_source.open_for_reading();
+			m_state = xxh64_state(m_seed);
+		}
+
+		status try_open_for_reading() noexcept override
+		{
+			status result = m_source.try_open_for_reading();
+			if (result.ok())
+				m_state = xxh64_state(m_seed);
+			return result;
+		}
+
+		void close() override { m_source.close(); }
+
+		void read(void* buffer, size_t element_size, size_t count) override
+		{
+			m_source.read(buffer, element_size, count);
+			m_state.update(buffer, element_size * count);
+		}
+
+		status try_read(void* buffer, size_t element_size, size_t count) noexcept override
+		{
+			status result = m_source.try_read(buffer, element_size, count);
+			if (result.ok())
+				m_state.update(buffer, element_size * count);
+			return result;
+		}
+
+		void seek(uint64_t position) override { m_source.seek(position); }
+		uint64_t size() override { return m_source.size(); }
+
+		//hash of the bytes read since the stream was opened
+		uint64_t digest() const { return m_state.digest(); }
+
+	private:
+		input_stream& m_source;
+		uint64_t m_seed;
+		xxh64_state m_state;
+	};
+
+}
+
+#endif //FBMP_HASH_H
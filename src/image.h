@@ -4,9 +4,11 @@
 #define FBMP_IMAGE_H
 
 #include <cstdint>
+#include <cstring>
 #include <string>
 
 #include "exception.h"
+#include "large_alloc.h"
 
 namespace fbmp
 {
@@ -31,6 +33,8 @@ namespace fbmp
 
 		inline void reset(size_t width, size_t height, size_t channels, size_t pitch = 0);
 		inline void reset(size_t width, size_t height, size_t channels, size_t pitch, uint8_t* data);
+		//owned buffer from allocate_large
+		inline void reset_large(size_t width, size_t height, size_t channels, size_t pitch = 0, size_t prefault_threads = 0);
 
 		inline size_t width() const;
 		inline size_t height() const;
@@ -47,10 +51,13 @@ namespace fbmp
 		inline const uint8_t* get_row_end(size_t row) const;
 
 		inline bool own_data() const;
+		inline bool large_data() const;
 
+		//large buffers are given back with free_large(data, pitch * height)
 		inline uint8_t* release();
 
 	private:
+		inline void allocate(size_t width, size_t height, size_t channels, size_t pitch, bool large, size_t prefault_threads);
 		inline void dealloc();
 
 	private:
@@ -60,6 +67,7 @@ namespace fbmp
 		size_t _pitch = 0;
 
 		bool		_ownData = true;
+		bool		_largeData = false;
 		uint8_t*	_dataPointer = nullptr;
 	};
 
@@ -86,6 +94,8 @@ namespace fbmp
 	inline image::image(image&& img)
 		: image(img._width, img._height, img._channels, img._pitch, img._dataPointer)
 	{
+		_ownData = img._ownData;
+		_largeData = img._largeData;
 		img.release();
 		img.reset(0, 0, 0, 0, nullptr);
 	}
@@ -113,29 +123,43 @@ namespace fbmp
 		std::swap(_channels, img._channels);
 		std::swap(_pitch, img._pitch);
 		std::swap(_ownData, img._ownData);
+		std::swap(_largeData, img._largeData);
 		std::swap(_dataPointer, img._dataPointer);
 
 		return *this;
 	}
 
 	inline void image::reset(size_t width, size_t height, size_t channels, size_t pitch)
+	{
+		allocate(width, height, channels, pitch, false, 0);
+	}
+
+	inline void image::reset_large(size_t width, size_t height, size_t channels, size_t pitch, size_t prefault_threads)
+	{
+		allocate(width, height, channels, pitch, true, prefault_threads);
+	}
+
+	inline void image::allocate(size_t width, size_t height, size_t channels, size_t pitch, bool large, size_t prefault_threads)
 	{
 		size_t minRowSize = width * channels;
 
 		if (pitch && minRowSize > pitch)
-			throw exception("Pitch is too small.");
+			throw exception(error_code::invalid_argument, "Pitch is too small.");
 
 		if (!pitch)
 			pitch = minRowSize;
 
-		if (_pitch * _height == pitch * height)
-			return;
+		//an owned buffer of the same size is reused, only the shape changes
+		if (!_ownData || !_dataPointer || _largeData != large || _pitch * _height != pitch * height)
+		{
+			uint8_t* newData = large ? allocate_large(pitch * height, prefault_threads) : new uint8_t[pitch * height];
+			dealloc();
 
-		uint8_t* newData = new uint8_t[pitch * height];
-		dealloc();
+			_ownData = true;
+			_largeData = large;
+			_dataPointer = newData;
+		}
 
-		_ownData = true;
-		_dataPointer = newData;
 		_width = width;
 		_height = height;
 		_channels = channels;
@@ -188,6 +212,7 @@ namespace fbmp
 	{
 		uint8_t* result = _dataPointer;
 		_ownData = false;
+		_largeData = false;
 		_width = 0;
 		_height = 0;
 		_dataPointer = 0;
@@ -219,13 +244,21 @@ namespace fbmp
 		return _ownData;
 	}
 
+	inline bool image::large_data() const
+	{
+		return _largeData;
+	}
+
 	inline void image::dealloc()
 	{
-		if (own_data())
+		if (own_data() && _largeData)
+			free_large(_dataPointer, _pitch * _height);
+		else if (own_data())
 			delete[] _dataPointer;
 
 		_dataPointer = nullptr;
 		_ownData = true;
+		_largeData = false;
 		_width = 0;
 		_height = 0;
 		_pitch = 0;
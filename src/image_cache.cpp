@@ -0,0 +1,74 @@
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include "image_cache.h"
+#include "file_stream.h"
+#include "reader.h"
+
+namespace fbmp
+{
+
+	namespace
+	{
+		const size_t shared_cache_budget = 512 * 1024 * 1024;
+	}
+
+	image_key image_key::from_file(const char* path)
+	{
+		image_key key;
+		key.name = path;
+
+#if defined(_WIN32)
+		struct _stat64 info;
+		if (_stat64(path, &info) != 0)
+			throw exception(error_code::open_failed, std::string("Can not stat file: {") + path + "}");
+		key.mtime = (int64_t)info.st_mtime * 1000000000;
+#else
+		struct stat info;
+		if (stat(path, &info) != 0)
+			throw exception(error_code::open_failed, std::string("Can not stat file: {") + path + "}");
+#if defined(__APPLE__)
+		key.mtime = (int64_t)info.st_mtimespec.tv_sec * 1000000000 + info.st_mtimespec.tv_nsec;
+#else
+		key.mtime = (int64_t)info.st_mtim.tv_sec * 1000000000 + info.st_mtim.tv_nsec;
+#endif
+#endif
+		key.device = (uint64_t)info.st_dev;
+		key.inode = (uint64_t)info.st_ino;
+		key.size = (uint64_t)info.st_size;
+		return key;
+	}
+
+	image_cache::image_cache(size_t budget)
+		: _cache(budget)
+	{}
+
+	image_cache& image_cache::shared()
+	{
+		static image_cache cache(shared_cache_budget);
+		return cache;
+	}
+
+	image_cache::image_ptr image_cache::get(const char* path)
+	{
+		const image_key key = image_key::from_file(path);
+		return _cache.get_or_load(key, [&]()
+		{
+			file_input_stream stream(path);
+			return decode(stream);
+		});
+	}
+
+	image_cache::image_ptr image_cache::get(const image_key& key, input_stream& stream)
+	{
+		return _cache.get_or_load(key, [&]() { return decode(stream); });
+	}
+
+	image_cache::image_ptr image_cache::decode(input_stream& stream)
+	{
+		reader r(stream);
+		r.read();
+		return std::make_shared<const image>(r.take_image());
+	}
+
+}
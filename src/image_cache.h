@@ -0,0 +1,84 @@
+
+#pragma once
+#ifndef FBMP_IMAGE_CACHE_H
+#define FBMP_IMAGE_CACHE_H
+
+#include <cstdint>
+#include <string>
+#include <memory>
+#include <functional>
+
+#include "stream.h"
+#include "image.h"
+#include "lru_cache.h"
+
+namespace fbmp
+{
+
+	//identifies one version of a file: a rewritten file gets a new key and the old entry ages out
+	struct image_key
+	{
+		std::string name;
+		uint64_t device = 0;
+		uint64_t inode = 0;
+		int64_t mtime = 0;	//nanoseconds
+		uint64_t size = 0;
+
+		bool operator==(const image_key& other) const
+		{
+			return name == other.name && device == other.device && inode == other.inode
+				&& mtime == other.mtime && size == other.size;
+		}
+
+		static image_key from_file(const char* path);
+		static image_key from_name(const std::string& name) { image_key key; key.name = name; return key; }
+	};
+
+	struct image_key_hash
+	{
+		size_t operator()(const image_key& key) const
+		{
+			size_t seed = std::hash<std::string>()(key.name);
+			const uint64_t values[] = { key.device, key.inode, (uint64_t)key.mtime, key.size };
+			for (uint64_t value : values)
+				seed ^= std::hash<uint64_t>()(value) + 0x9e3779b97f4a7c15ull + (seed << 6) + (seed >> 2);
+			return seed;
+		}
+	};
+
+	//thread safe cache of decoded images in front of reader
+	//hits hand out the cached image itself, concurrent misses for one key decode the file once
+	class image_cache
+	{
+	public:
+		typedef std::shared_ptr<const image> image_ptr;
+
+		explicit image_cache(size_t budget);
+
+		image_cache(const image_cache&) = delete;
+		image_cache& operator=(const image_cache&) = delete;
+
+		//process wide instance
+		static image_cache& shared();
+
+		image_ptr get(const char* path);
+		image_ptr get(const image_key& key, input_stream& stream);
+
+		void erase(const image_key& key) { _cache.erase(key); }
+		void clear() { _cache.clear(); }
+
+		size_t budget() const { return _cache.budget(); }
+		size_t memory_used() const { return _cache.memory_used(); }
+		size_t hits() const { return _cache.hits(); }
+		size_t misses() const { return _cache.misses(); }
+
+	private:
+		static image_ptr decode(input_stream& stream);
+
+	private:
+		lru_cache<image_key, image, image_cost, image_key_hash> _cache;
+	};
+
+}
+
+#endif //FBMP_IMAGE_CACHE_H
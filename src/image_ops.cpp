@@ -0,0 +1,311 @@
+
+#include <vector>
+#include <cstring>
+#include <algorithm>
+#include "image_ops.h"
+#include "simd.h"
+#include "parallel.h"
+
+namespace fbmp
+{
+
+	namespace
+	{
+		//pixel (x, y) of src goes to pixel (y, x) of dst, pitches may be negative to mirror rows
+		template <int Channels>
+		void transpose_scalar(const uint8_t* src, ptrdiff_t src_pitch, uint8_t* dst, ptrdiff_t dst_pitch, size_t width, size_t height)
+		{
+			for (size_t y = 0; y < height; ++y)
+			{
+				const uint8_t* s = src + src_pitch * (ptrdiff_t)y;
+				for (size_t x = 0; x < width; ++x)
+					memcpy(dst + dst_pitch * (ptrdiff_t)x + y * Channels, s + x * Channels, Channels);
+			}
+		}
+
+		//square blocks transposed in registers, size 0 - no vector kernel for the pixel size
+		template <int Channels>
+		struct transpose_block
+		{
+			static const size_t size = 0;
+			static void apply(const uint8_t*, ptrdiff_t, uint8_t*, ptrdiff_t) {}
+		};
+
+#if defined(FBMP_SSE2)
+		template <>
+		struct transpose_block<1>
+		{
+			static const size_t size = 8;
+
+			static void apply(const uint8_t* src, ptrdiff_t src_pitch, uint8_t* dst, ptrdiff_t dst_pitch)
+			{
+				__m128i r[8];
+				for (int i = 0; i < 8; ++i)
+					r[i] = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(src + src_pitch * i));
+
+				const __m128i t0 = _mm_unpacklo_epi8(r[0], r[1]);
+				const __m128i t1 = _mm_unpacklo_epi8(r[2], r[3]);
+				const __m128i t2 = _mm_unpacklo_epi8(r[4], r[5]);
+				const __m128i t3 = _mm_unpacklo_epi8(r[6], r[7]);
+				const __m128i u0 = _mm_unpacklo_epi16(t0, t1);
+				const __m128i u1 = _mm_unpackhi_epi16(t0, t1);
+				const __m128i u2 = _mm_unpacklo_epi16(t2, t3);
+				const __m128i u3 = _mm_unpackhi_epi16(t2, t3);
+
+				//every register holds two output rows
+				const __m128i rows[4] = {
+					_mm_unpacklo_epi32(u0, u2), _mm_unpackhi_epi32(u0, u2),
+					_mm_unpacklo_epi32(u1, u3), _mm_unpackhi_epi32(u1, u3) };
+				for (int i = 0; i < 4; ++i)
+				{
+					_mm_storel_epi64(reinterpret_cast<__m128i*>(dst + dst_pitch * (i * 2)), rows[i]);
+					_mm_storel_epi64(reinterpret_cast<__m128i*>(dst + dst_pitch * (i * 2 + 1)), _mm_srli_si128(rows[i], 8));
+				}
+			}
+		};
+
+		inline void transpose_4x4_epi32(__m128i& r0, __m128i& r1, __m128i& r2, __m128i& r3)
+		{
+			const __m128i t0 = _mm_unpacklo_epi32(r0, r1);
+			const __m128i t1 = _mm_unpacklo_epi32(r2, r3);
+			const __m128i t2 = _mm_unpackhi_epi32(r0, r1);
+			const __m128i t3 = _mm_unpackhi_epi32(r2, r3);
+			r0 = _mm_unpacklo_epi64(t0, t1);
+			r1 = _mm_unpackhi_epi64(t0, t1);
+			r2 = _mm_unpacklo_epi64(t2, t3);
+			r3 = _mm_unpackhi_epi64(t2, t3);
+		}
+
+		template <>
+		struct transpose_block<4>
+		{
+			static const size_t size = 4;
+
+			static void apply(const uint8_t* src, ptrdiff_t src_pitch, uint8_t* dst, ptrdiff_t dst_pitch)
+			{
+				__m128i r[4];
+				for (int i = 0; i < 4; ++i)
+					r[i] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + src_pitch * i));
+				transpose_4x4_epi32(r[0], r[1], r[2], r[3]);
+				for (int i = 0; i < 4; ++i)
+					_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + dst_pitch * i), r[i]);
+			}
+		};
+#endif
+
+#if defined(FBMP_SSSE3)
+		//3 byte pixels are widened to 4 bytes, transposed as 32-bit lanes and packed back
+		template <>
+		struct transpose_block<3>
+		{
+			static const size_t size = 4;
+
+			static void apply(const uint8_t* src, ptrdiff_t src_pitch, uint8_t* dst, ptrdiff_t dst_pitch)
+			{
+				const __m128i widen = _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+				const __m128i narrow = _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+
+				__m128i r[4];
+				for (int i = 0; i < 4; ++i)
+				{
+					const uint8_t* row = src + src_pitch * i;
+					uint32_t last;
+					memcpy(&last, row + 8, 4);
+					const __m128i value = _mm_or_si128(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(row)), _mm_slli_si128(_mm_cvtsi32_si128((int)last), 8));
+					r[i] = _mm_shuffle_epi8(value, widen);
+				}
+				transpose_4x4_epi32(r[0], r[1], r[2], r[3]);
+				for (int i = 0; i < 4; ++i)
+				{
+					uint8_t* row = dst + dst_pitch * i;
+					const __m128i value = _mm_shuffle_epi8(r[i], narrow);
+					_mm_storel_epi64(reinterpret_cast<__m128i*>(row), value);
+					const uint32_t last = (uint32_t)_mm_cvtsi128_si32(_mm_srli_si128(value, 8));
+					memcpy(row + 8, &last, 4);
+				}
+			}
+		};
+#endif
+
+		template <int Channels>
+		void transpose_tile(const uint8_t* src, ptrdiff_t src_pitch, uint8_t* dst, ptrdiff_t dst_pitch, size_t width, size_t height)
+		{
+			typedef transpose_block<Channels> block;
+
+			size_t y = 0;
+			if (block::size)
+			{
+				for (; y + block::size <= height; y += block::size)
+				{
+					const uint8_t* s = src + src_pitch * (ptrdiff_t)y;
+					size_t x = 0;
+					for (; x + block::size <= width; x += block::size)
+						block::apply(s + x * Channels, src_pitch, dst + dst_pitch * (ptrdiff_t)x + y * Channels, dst_pitch);
+					transpose_scalar<Channels>(s + x * Channels, src_pitch, dst + dst_pitch * (ptrdiff_t)x + y * Channels, dst_pitch, width - x, block::size);
+				}
+			}
+			transpose_scalar<Channels>(src + src_pitch * (ptrdiff_t)y, src_pitch, dst + y * Channels, dst_pitch, width, height - y);
+		}
+
+		//bands of tile rows go to the workers, a band writes its own columns of dst
+		template <int Channels>
+		void transpose_image(const uint8_t* src, ptrdiff_t src_pitch, uint8_t* dst, ptrdiff_t dst_pitch, size_t width, size_t height, size_t threads)
+		{
+			const size_t tile = Channels == 1 ? 64 : 32;
+			const size_t bands = (height + tile - 1) / tile;
+			parallel_for(bands, threads, [&](size_t band)
+			{
+				const size_t y = band * tile;
+				const size_t rows = std::min(tile, height - y);
+				for (size_t x = 0; x < width; x += tile)
+				{
+					transpose_tile<Channels>(src + src_pitch * (ptrdiff_t)y + x * Channels, src_pitch,
+						dst + dst_pitch * (ptrdiff_t)x + y * Channels, dst_pitch, std::min(tile, width - x), rows);
+				}
+			});
+		}
+
+		void transpose_pixels(const uint8_t* src, ptrdiff_t src_pitch, uint8_t* dst, ptrdiff_t dst_pitch, size_t width, size_t height, size_t channels, size_t threads)
+		{
+			switch (channels)
+			{
+			case 1:
+				return transpose_image<1>(src, src_pitch, dst, dst_pitch, width, height, threads);
+			case 2:
+				return transpose_image<2>(src, src_pitch, dst, dst_pitch, width, height, threads);
+			case 3:
+				return transpose_image<3>(src, src_pitch, dst, dst_pitch, width, height, threads);
+			case 4:
+				return transpose_image<4>(src, src_pitch, dst, dst_pitch, width, height, threads);
+			default:
+				throw exception(error_code::invalid_argument, "Only 1 to 4 channels are supported.");
+			}
+		}
+
+		//pixel x of src goes to pixel width - 1 - x of dst, src and dst must not overlap
+		template <int Channels>
+		void reverse_row(const uint8_t* src, uint8_t* dst, size_t width)
+		{
+			size_t x = 0;
+#if defined(FBMP_SSSE3)
+			if (Channels == 1)
+			{
+				const __m128i mask = _mm_setr_epi8(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0);
+				for (; x + 16 <= width; x += 16)
+				{
+					const __m128i value = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + x));
+					_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + width - x - 16), _mm_shuffle_epi8(value, mask));
+				}
+			}
+#endif
+#if defined(FBMP_SSE2)
+			if (Channels == 4)
+			{
+				for (; x + 4 <= width; x += 4)
+				{
+					const __m128i value = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + x * 4));
+					_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + (width - x - 4) * 4), _mm_shuffle_epi32(value, _MM_SHUFFLE(0, 1, 2, 3)));
+				}
+			}
+#endif
+			for (; x < width; ++x)
+				memcpy(dst + (width - 1 - x) * Channels, src + x * Channels, Channels);
+		}
+
+		typedef void (*reverse_row_fn)(const uint8_t* src, uint8_t* dst, size_t width);
+
+		reverse_row_fn select_reverse(size_t channels)
+		{
+			switch (channels)
+			{
+			case 1:
+				return reverse_row<1>;
+			case 2:
+				return reverse_row<2>;
+			case 3:
+				return reverse_row<3>;
+			case 4:
+				return reverse_row<4>;
+			default:
+				throw exception(error_code::invalid_argument, "Only 1 to 4 channels are supported.");
+			}
+		}
+	}
+
+	void flip_horizontal(const image_view& img)
+	{
+		const reverse_row_fn reverse = select_reverse(img.channels());
+		std::vector<uint8_t> row(img.row_size());
+		for (size_t y = 0; y < img.height(); ++y)
+		{
+			memcpy(row.data(), img.get_row_begin(y), img.row_size());
+			reverse(row.data(), img.get_row_begin(y), img.width());
+		}
+	}
+
+	void flip_vertical(const image_view& img)
+	{
+		for (size_t top = 0, bottom = img.height(); top + 1 < bottom; ++top)
+		{
+			--bottom;
+			std::swap_ranges(img.get_row_begin(top), img.get_row_end(top), img.get_row_begin(bottom));
+		}
+	}
+
+	void transpose(const_image_view src, const image_view& dst, size_t threads)
+	{
+		if (dst.width() != src.height() || dst.height() != src.width() || dst.channels() != src.channels())
+			throw exception(error_code::invalid_argument, "Transposed image has a wrong size.");
+
+		transpose_pixels(src.data(), (ptrdiff_t)src.pitch(), dst.data(), (ptrdiff_t)dst.pitch(), src.width(), src.height(), src.channels(), threads);
+	}
+
+	void rotate(const_image_view src, const image_view& dst, rotation angle, size_t threads)
+	{
+		const bool swapped = angle == rotation::rotate_90 || angle == rotation::rotate_270;
+		if (dst.width() != (swapped ? src.height() : src.width()) || dst.height() != (swapped ? src.width() : src.height()) || dst.channels() != src.channels())
+			throw exception(error_code::invalid_argument, "Rotated image has a wrong size.");
+		if (src.empty())
+			return;
+
+		const ptrdiff_t src_pitch = (ptrdiff_t)src.pitch();
+		const ptrdiff_t dst_pitch = (ptrdiff_t)dst.pitch();
+
+		switch (angle)
+		{
+		case rotation::none:
+			for (size_t y = 0; y < src.height(); ++y)
+				memcpy(dst.get_row_begin(y), src.get_row_begin(y), src.row_size());
+			break;
+		case rotation::rotate_90:
+			//transpose of src read bottom-up
+			transpose_pixels(src.get_row_begin(src.height() - 1), -src_pitch, dst.data(), dst_pitch, src.width(), src.height(), src.channels(), threads);
+			break;
+		case rotation::rotate_270:
+			//transpose written into dst bottom-up
+			transpose_pixels(src.data(), src_pitch, dst.get_row_begin(dst.height() - 1), -dst_pitch, src.width(), src.height(), src.channels(), threads);
+			break;
+		case rotation::rotate_180:
+		{
+			const reverse_row_fn reverse = select_reverse(src.channels());
+			const size_t band = 64;
+			parallel_for((src.height() + band - 1) / band, threads, [&](size_t index)
+			{
+				const size_t end = std::min(src.height(), (index + 1) * band);
+				for (size_t y = index * band; y < end; ++y)
+					reverse(src.get_row_begin(y), dst.get_row_begin(src.height() - 1 - y), src.width());
+			});
+			break;
+		}
+		}
+	}
+
+	image rotate(const_image_view src, rotation angle, size_t threads)
+	{
+		const bool swapped = angle == rotation::rotate_90 || angle == rotation::rotate_270;
+		image result(swapped ? src.height() : src.width(), swapped ? src.width() : src.height(), src.channels());
+		rotate(src, image_view(result), angle, threads);
+		return result;
+	}
+
+}
@@ -0,0 +1,31 @@
+
+#pragma once
+#ifndef FBMP_IMAGE_OPS_H
+#define FBMP_IMAGE_OPS_H
+
+#include <cstdint>
+#include <cstddef>
+
+#include "image.h"
+#include "image_view.h"
+#include "decode_target.h"
+
+namespace fbmp
+{
+
+	//geometric operations on 8-bit images with 1 to 4 channels
+	//transposes work in cache sized tiles, threads splits the tiles between worker threads
+
+	void flip_horizontal(const image_view& img);
+	void flip_vertical(const image_view& img);
+
+	//dst is height x width of src
+	void transpose(const_image_view src, const image_view& dst, size_t threads = 1);
+
+	//dst is height x width of src for 90 and 270 degrees, src and dst must not overlap
+	void rotate(const_image_view src, const image_view& dst, rotation angle, size_t threads = 1);
+	image rotate(const_image_view src, rotation angle, size_t threads = 1);
+
+}
+
+#endif //FBMP_IMAGE_OPS_H
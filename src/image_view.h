@@ -0,0 +1,105 @@
+
+#pragma once
+#ifndef FBMP_IMAGE_VIEW_H
+#define FBMP_IMAGE_VIEW_H
+
+#include <cstdint>
+#include <cstddef>
+#include <type_traits>
+
+#include "exception.h"
+#include "image.h"
+
+namespace fbmp
+{
+
+	//non-owning window over interleaved 8-bit pixels; copying a view never copies pixel data
+	template <typename T>
+	class basic_image_view
+	{
+	public:
+		typedef T value_type;
+		typedef typename std::conditional<std::is_const<T>::value, const image, image>::type image_type;
+
+		inline basic_image_view() = default;
+		inline basic_image_view(T* data, size_t width, size_t height, size_t channels, size_t pitch = 0);
+		inline basic_image_view(image_type& img);
+
+		template <typename U, typename = typename std::enable_if<std::is_convertible<U*, T*>::value>::type>
+		inline basic_image_view(const basic_image_view<U>& view);
+
+		inline size_t width() const { return _width; }
+		inline size_t height() const { return _height; }
+		inline size_t channels() const { return _channels; }
+		inline size_t pitch() const { return _pitch; }
+		inline size_t row_size() const { return _width * _channels; }
+		inline bool empty() const { return _width == 0 || _height == 0; }
+
+		inline T* data() const { return _dataPointer; }
+
+		inline T* get_row_begin(size_t row) const { return _dataPointer + _pitch * row; }
+		inline T* get_row_end(size_t row) const { return _dataPointer + _pitch * row + _width * _channels; }
+		inline T* get_pixel(size_t x, size_t y) const { return _dataPointer + _pitch * y + x * _channels; }
+
+		inline basic_image_view subview(size_t x, size_t y, size_t width, size_t height) const;
+
+	private:
+		T*		_dataPointer = nullptr;
+		size_t	_width = 0;
+		size_t	_height = 0;
+		size_t	_channels = 0;
+		size_t	_pitch = 0;
+	};
+
+	typedef basic_image_view<uint8_t> image_view;
+	typedef basic_image_view<const uint8_t> const_image_view;
+
+	template <typename T>
+	inline basic_image_view<T>::basic_image_view(T* data, size_t width, size_t height, size_t channels, size_t pitch)
+		: _dataPointer(data)
+		, _width(width)
+		, _height(height)
+		, _channels(channels)
+		, _pitch(pitch ? pitch : width * channels)
+	{
+		if (_pitch < width * channels)
+			throw exception(error_code::invalid_argument, "Pitch is too small.");
+	}
+
+	template <typename T>
+	inline basic_image_view<T>::basic_image_view(image_type& img)
+		: _dataPointer(img.data())
+		, _width(img.width())
+		, _height(img.height())
+		, _channels(img.channels())
+		, _pitch(img.pitch())
+	{}
+
+	template <typename T>
+	template <typename U, typename>
+	inline basic_image_view<T>::basic_image_view(const basic_image_view<U>& view)
+		: _dataPointer(view.data())
+		, _width(view.width())
+		, _height(view.height())
+		, _channels(view.channels())
+		, _pitch(view.pitch())
+	{}
+
+	template <typename T>
+	inline basic_image_view<T> basic_image_view<T>::subview(size_t x, size_t y, size_t width, size_t height) const
+	{
+		if (x > _width || width > _width - x || y > _height || height > _height - y)
+			throw exception(error_code::invalid_argument, "Subview is out of image bounds.");
+
+		basic_image_view result;
+		result._dataPointer = get_pixel(x, y);
+		result._width = width;
+		result._height = height;
+		result._channels = _channels;
+		result._pitch = _pitch;
+		return result;
+	}
+
+}
+
+#endif //FBMP_IMAGE_VIEW_H
@@ -0,0 +1,80 @@
+
+#include <new>
+#include "large_alloc.h"
+#include "parallel.h"
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+namespace fbmp
+{
+
+	namespace
+	{
+		const size_t huge_page_size = 2 * 1024 * 1024;
+		const size_t page_size = 4096;
+
+		//mappings are made in whole huge pages, free_large rounds the same way
+		size_t mapped_size(size_t size)
+		{
+			return (size + huge_page_size - 1) / huge_page_size * huge_page_size;
+		}
+
+		void prefault(uint8_t* data, size_t size, size_t threads)
+		{
+			const size_t chunk = 16 * huge_page_size;
+			parallel_for((size + chunk - 1) / chunk, threads, [&](size_t i)
+			{
+				const size_t end = std::min(size, (i + 1) * chunk);
+				for (size_t offset = i * chunk; offset < end; offset += page_size)
+					static_cast<volatile uint8_t*>(data)[offset] = 0;
+			});
+		}
+	}
+
+	uint8_t* allocate_large(size_t size, size_t prefault_threads)
+	{
+		const size_t length = mapped_size(size);
+		void* data = nullptr;
+
+#if defined(_WIN32)
+		data = VirtualAlloc(nullptr, length, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+		if (!data)
+			throw std::bad_alloc();
+#else
+		//explicit huge pages only exist when the administrator reserved them, transparent ones are the fallback
+		//the page size is requested explicitly (log2 of 2MB), the system default may be 1GB
+#if defined(MAP_HUGETLB) && defined(MAP_HUGE_SHIFT)
+		data = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | (21 << MAP_HUGE_SHIFT), -1, 0);
+		if (data == MAP_FAILED)
+#endif
+		{
+			data = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+			if (data == MAP_FAILED)
+				throw std::bad_alloc();
+#if defined(MADV_HUGEPAGE)
+			madvise(data, length, MADV_HUGEPAGE);
+#endif
+		}
+#endif
+
+		if (prefault_threads)
+			prefault(static_cast<uint8_t*>(data), length, prefault_threads);
+		return static_cast<uint8_t*>(data);
+	}
+
+	void free_large(uint8_t* data, size_t size)
+	{
+		if (!data)
+			return;
+#if defined(_WIN32)
+		(void)size;
+		VirtualFree(data, 0, MEM_RELEASE);
+#else
+		munmap(data, mapped_size(size));
+#endif
+	}
+
+}
@@ -0,0 +1,19 @@
+
+#pragma once
+#ifndef FBMP_LARGE_ALLOC_H
+#define FBMP_LARGE_ALLOC_H
+
+#include <cstdint>
+#include <cstddef>
+
+namespace fbmp
+{
+
+	//page mapped buffers for large images, backed by huge pages where the system provides them
+	//prefault_threads > 0 touches every page up front on that many threads, so the decode does not fault
+	uint8_t* allocate_large(size_t size, size_t prefault_threads = 0);
+	void free_large(uint8_t* data, size_t size);
+
+}
+
+#endif //FBMP_LARGE_ALLOC_H
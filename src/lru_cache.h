@@ -0,0 +1,210 @@
+
+#pragma once
+#ifndef FBMP_LRU_CACHE_H
+#define FBMP_LRU_CACHE_H
+
+#include <cstddef>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <future>
+#include <utility>
+#include <functional>
+#include <unordered_map>
+
+#include "image.h"
+
+namespace fbmp
+{
+
+	struct image_cost
+	{
+		size_t operator()(const image& img) const { return img.pitch() * img.height(); }
+	};
+
+	//thread safe, memory bounded least recently used cache of shared read-only values
+	//values handed out stay alive while the caller holds them, the budget only covers what the cache keeps
+	//concurrent misses for the same key run the loader once, the other callers wait for its result
+	template <typename Key, typename Value, typename Cost = image_cost, typename Hash = std::hash<Key> >
+	class lru_cache
+	{
+	public:
+		typedef std::shared_ptr<const Value> value_ptr;
+
+		explicit lru_cache(size_t budget)
+			: _budget(budget)
+		{}
+
+		lru_cache(const lru_cache&) = delete;
+		lru_cache& operator=(const lru_cache&) = delete;
+
+		value_ptr find(const Key& key)
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			return touch(key);
+		}
+
+		bool contains(const Key& key) const
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			return _entries.count(key) != 0 || _pending.count(key) != 0;
+		}
+
+		void insert(const Key& key, value_ptr value)
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			store(key, std::move(value));
+		}
+
+		template <typename Loader>
+		value_ptr get_or_load(const Key& key, Loader&& load)
+		{
+			std::shared_ptr<std::promise<value_ptr> > promise;
+			{
+				std::unique_lock<std::mutex> lock(_mutex);
+				value_ptr value = touch(key);
+				if (value)
+				{
+					++_hits;
+					return value;
+				}
+
+				auto pending = _pending.find(key);
+				if (pending != _pending.end())
+				{
+					std::shared_future<value_ptr> result = pending->second;
+					++_hits;
+					lock.unlock();
+					return result.get();
+				}
+
+				++_misses;
+				promise = std::make_shared<std::promise<value_ptr> >();
+				_pending.emplace(key, promise->get_future().share());
+			}
+
+			value_ptr value;
+			try
+			{
+				value = load();
+			}
+			catch (...)
+			{
+				std::lock_guard<std::mutex> lock(_mutex);
+				_pending.erase(key);
+				promise->set_exception(std::current_exception());
+				throw;
+			}
+
+			{
+				std::lock_guard<std::mutex> lock(_mutex);
+				_pending.erase(key);
+				store(key, value);
+			}
+			promise->set_value(value);
+			return value;
+		}
+
+		void erase(const Key& key)
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			auto it = _entries.find(key);
+			if (it == _entries.end())
+				return;
+			_used -= it->second.cost;
+			_order.erase(it->second.position);
+			_entries.erase(it);
+		}
+
+		void clear()
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			_entries.clear();
+			_order.clear();
+			_used = 0;
+		}
+
+		size_t budget() const { return _budget; }
+
+		size_t memory_used() const
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			return _used;
+		}
+
+		size_t hits() const
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			return _hits;
+		}
+
+		size_t misses() const
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			return _misses;
+		}
+
+	private:
+		struct entry
+		{
+			value_ptr value;
+			size_t cost;
+			typename std::list<Key>::iterator position;
+		};
+
+		value_ptr touch(const Key& key)
+		{
+			auto it = _entries.find(key);
+			if (it == _entries.end())
+				return value_ptr();
+			_order.splice(_order.begin(), _order, it->second.position);
+			return it->second.value;
+		}
+
+		void store(const Key& key, value_ptr value)
+		{
+			const size_t cost = value ? Cost()(*value) : 0;
+			auto it = _entries.find(key);
+			if (it != _entries.end())
+			{
+				_used -= it->second.cost;
+				_order.erase(it->second.position);
+				_entries.erase(it);
+			}
+
+			//a value larger than the whole budget is handed out but never kept
+			if (!value || cost > _budget)
+				return;
+
+			while (_used + cost > _budget && !_order.empty())
+			{
+				auto victim = _entries.find(_order.back());
+				_used -= victim->second.cost;
+				_entries.erase(victim);
+				_order.pop_back();
+			}
+
+			_order.push_front(key);
+			entry e;
+			e.value = std::move(value);
+			e.cost = cost;
+			e.position = _order.begin();
+			_entries.emplace(key, std::move(e));
+			_used += cost;
+		}
+
+	private:
+		mutable std::mutex _mutex;
+		const size_t _budget;
+		size_t _used = 0;
+		size_t _hits = 0;
+		size_t _misses = 0;
+
+		std::list<Key> _order;
+		std::unordered_map<Key, entry, Hash> _entries;
+		std::unordered_map<Key, std::shared_future<value_ptr>, Hash> _pending;
+	};
+
+}
+
+#endif //FBMP_LRU_CACHE_H
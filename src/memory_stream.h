@@ -0,0 +1,171 @@
+
+#pragma once
+#ifndef FBMP_MEMORY_STREAM_H
+#define FBMP_MEMORY_STREAM_H
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include <mutex>
+#include <string>
+#include "exception.h"
+#include "stream.h"
+
+namespace fbmp
+{
+
+	//reads a caller owned span in place, no system calls and no copies besides the ones read makes
+	class memory_input_stream : public input_stream
+	{
+	public:
+		memory_input_stream(const uint8_t* data = nullptr, size_t size = 0)
+			: m_data(data)
+			, m_size(size)
+		{}
+
+		void open_for_reading() override
+		{
+			m_position = 0;
+		}
+
+		status try_open_for_reading() noexcept override
+		{
+			m_position = 0;
+			return status();
+		}
+
+		void close() override
+		{}
+
+		void read(void* buffer, size_t element_size, size_t count) override
+		{
+			if (!fits(element_size, count))
+				throw exception(error_code::read_failed, "can not read expected size of data");
+			memcpy(buffer, m_data + m_position, element_size * count);
+			m_position += element_size * count;
+		}
+
+		status try_read(void* buffer, size_t element_size, size_t count) noexcept override
+		{
+			if (!fits(element_size, count))
+				return status(error_code::read_failed, "can not read expected size of data");
+			memcpy(buffer, m_data + m_position, element_size * count);
+			m_position += element_size * count;
+			return status();
+		}
+
+		void seek(uint64_t position) override
+		{
+			if (position > m_size)
+				throw exception(error_code::read_failed, std::string("Can not seek to ") + std::to_string(position) + " in memory stream.");
+			m_position = (size_t)position;
+		}
+
+		uint64_t size() override { return m_size; }
+
+		const uint8_t* data() const { return m_data; }
+
+	private:
+		bool fits(size_t element_size, size_t count) const
+		{
+			return !element_size || count <= (m_size - m_position) / element_size;
+		}
+
+		const uint8_t* m_data;
+		size_t m_size;
+		size_t m_position = 0;
+	};
+
+	//writes into a caller provided span, or into an owned buffer that grows as needed
+	class memory_output_stream : public positional_output_stream
+	{
+	public:
+		//growable, capacity bytes are allocated up front - pass writer::encoded_size to never reallocate
+		explicit memory_output_stream(size_t capacity = 0)
+			: m_data(nullptr)
+			, m_capacity(0)
+		{
+			m_buffer.reserve(capacity);
+		}
+
+		//fixed span, writing past capacity throws
+		memory_output_stream(uint8_t* data, size_t capacity)
+			: m_data(data)
+			, m_capacity(capacity)
+		{}
+
+		memory_output_stream(const memory_output_stream&) = delete;
+		memory_output_stream& operator=(const memory_output_stream&) = delete;
+
+		void open_for_writing() override
+		{
+			m_position = 0;
+			m_size = 0;
+			m_buffer.clear();
+		}
+
+		void close() override
+		{}
+
+		void write(const void* buffer, size_t element_size, size_t count) override
+		{
+			const size_t size = element_size * count;
+			std::lock_guard<std::mutex> lock(m_mutex);
+			memcpy(extend(m_position, size), buffer, size);
+			m_position += size;
+		}
+
+		void reserve(uint64_t size) override
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			extend(0, (size_t)size);
+		}
+
+		void write_at(uint64_t offset, const void* buffer, size_t size) override
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			uint8_t* out = extend((size_t)offset, size);
+			//a span never moves, so its copies run in parallel; a growing buffer may be reallocated by another write
+			if (m_data)
+				lock.unlock();
+			memcpy(out, buffer, size);
+		}
+
+		//bytes up to the end of the furthest write or reserve
+		const uint8_t* data() const { return m_data ? m_data : m_buffer.data(); }
+		size_t size() const { return m_size; }
+
+		//the owned buffer, sized to size()
+		std::vector<uint8_t>& buffer() { return m_buffer; }
+
+	private:
+		uint8_t* extend(size_t offset, size_t size)
+		{
+			const size_t end = offset + size;
+			if (m_data)
+			{
+				if (end > m_capacity)
+					throw exception(error_code::write_failed, "Memory output stream is full.");
+			}
+			else if (end > m_buffer.size())
+			{
+				m_buffer.resize(end);
+			}
+
+			if (end > m_size)
+				m_size = end;
+			return (m_data ? m_data : m_buffer.data()) + offset;
+		}
+
+	private:
+		uint8_t* m_data;
+		size_t m_capacity;
+		std::vector<uint8_t> m_buffer;
+		size_t m_position = 0;
+		size_t m_size = 0;
+		std::mutex m_mutex;
+	};
+
+}
+
+#endif //FBMP_MEMORY_STREAM_H
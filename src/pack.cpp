@@ -0,0 +1,333 @@
+
+#include <cstring>
+#include <memory>
+#include <algorithm>
+#include "pack.h"
+#include "data_types.h"
+#include "reader.h"
+#include "parallel.h"
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+namespace fbmp
+{
+
+	namespace
+	{
+		const char pack_magic[4] = {'F', 'B', 'P', 'K'};
+		const uint32_t pack_version = 1;
+		const size_t copy_chunk = 256 * 1024;
+
+		//the mapping outlives the file handles it was made from
+		const uint8_t* map_file(const char* path, size_t& size)
+		{
+#if defined(_WIN32)
+			HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+			if (file == INVALID_HANDLE_VALUE)
+				throw exception(error_code::open_failed, std::string("Can not open file: {") + path + "} for reading.");
+			LARGE_INTEGER length;
+			HANDLE mapping = GetFileSizeEx(file, &length) && length.QuadPart ? CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr) : nullptr;
+			const void* data = mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+			if (mapping)
+				CloseHandle(mapping);
+			CloseHandle(file);
+			if (!data)
+				throw exception(error_code::open_failed, std::string("Can not map file: {") + path + "}.");
+			size = (size_t)length.QuadPart;
+			return static_cast<const uint8_t*>(data);
+#else
+			const int fd = open(path, O_RDONLY | O_CLOEXEC);
+			if (fd < 0)
+				throw exception(error_code::open_failed, std::string("Can not open file: {") + path + "} for reading.");
+			struct stat info;
+			void* data = MAP_FAILED;
+			if (fstat(fd, &info) == 0 && info.st_size > 0)
+				data = mmap(nullptr, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+			close(fd);
+			if (data == MAP_FAILED)
+				throw exception(error_code::open_failed, std::string("Can not map file: {") + path + "}.");
+			size = (size_t)info.st_size;
+			return static_cast<const uint8_t*>(data);
+#endif
+		}
+
+		void unmap_file(const uint8_t* data, size_t size)
+		{
+#if defined(_WIN32)
+			(void)size;
+			UnmapViewOfFile(data);
+#else
+			munmap(const_cast<uint8_t*>(data), size);
+#endif
+		}
+
+		//names become paths below an output directory: no empty, absolute or drive names, no .. components
+		bool is_relative_name(const std::string& name)
+		{
+			if (name.empty() || name[0] == '/' || name[0] == '\\' || name.find_first_of(std::string(":\0", 2)) != std::string::npos)
+				return false;
+			for (size_t begin = 0; begin <= name.size();)
+			{
+				const size_t end = std::min(name.find_first_of("/\\", begin), name.size());
+				if (name.compare(begin, end - begin, "..") == 0)
+					return false;
+				begin = end + 1;
+			}
+			return true;
+		}
+
+		//offset + size within limit, without overflowing
+		bool within(uint64_t offset, uint64_t size, uint64_t limit)
+		{
+			return offset <= limit && size <= limit - offset;
+		}
+	}
+
+	pack_writer::pack_writer(positional_output_stream& stream)
+		: _stream(stream)
+	{
+		_stream.open_for_writing();
+		_open = true;
+
+		//every write is positional, the header is rewritten by finish once the index offset is known
+		pack_header header;
+		memset(&header, 0, sizeof(header));
+		_stream.write_at(0, &header, sizeof(header));
+		_offset = sizeof(header);
+	}
+
+	pack_writer::~pack_writer()
+	{
+		if (_open)
+			_stream.close();
+	}
+
+	void pack_writer::add(const std::string& name, const uint8_t* data, size_t size)
+	{
+		if (!is_relative_name(name))
+			throw exception(error_code::invalid_argument, "Pack entry name " + name + " is not a relative path.");
+		if (size < sizeof(main_header) || data[0] != 'B' || data[1] != 'M')
+			throw exception(error_code::bad_magic, "Pack entry " + name + " is not a bmp file.");
+
+		pack_index_entry entry;
+		entry.offset = _offset;
+		entry.size = size;
+		entry.name_offset = _names.size();
+		entry.name_size = name.size();
+
+		_stream.write_at(_offset, data, size);
+		_offset += size;
+		_names += name;
+		_index.push_back(entry);
+	}
+
+	void pack_writer::add(const std::string& name, input_stream& bmp)
+	{
+		if (!is_relative_name(name))
+			throw exception(error_code::invalid_argument, "Pack entry name " + name + " is not a relative path.");
+		input_stream_handle handle(bmp);
+		const uint64_t size = bmp.size();
+		if (size < sizeof(main_header))
+			throw exception(error_code::bad_magic, "Pack entry " + name + " is not a bmp file.");
+
+		pack_index_entry entry;
+		entry.offset = _offset;
+		entry.size = size;
+		entry.name_offset = _names.size();
+		entry.name_size = name.size();
+
+		//a stream failing halfway leaves unindexed bytes behind, the next entry starts after them
+		std::unique_ptr<uint8_t[]> buffer(new uint8_t[(size_t)std::min<uint64_t>(size, copy_chunk)]);
+		uint64_t done = 0;
+		try
+		{
+			while (done < size)
+			{
+				const size_t chunk = (size_t)std::min<uint64_t>(size - done, copy_chunk);
+				bmp.read(buffer.get(), 1, chunk);
+				if (!done && (buffer[0] != 'B' || buffer[1] != 'M'))
+					throw exception(error_code::bad_magic, "Pack entry " + name + " is not a bmp file.");
+				_stream.write_at(_offset + done, buffer.get(), chunk);
+				done += chunk;
+			}
+		}
+		catch (...)
+		{
+			_offset += done;
+			throw;
+		}
+
+		_offset += size;
+		_names += name;
+		_index.push_back(entry);
+	}
+
+	void pack_writer::finish()
+	{
+		const uint64_t names_offset = _offset;
+		for (pack_index_entry& entry : _index)
+			entry.name_offset += names_offset;
+		_stream.write_at(names_offset, _names.data(), _names.size());
+
+		pack_header header;
+		memcpy(header.magic, pack_magic, sizeof(pack_magic));
+		header.version = pack_version;
+		header.count = _index.size();
+		header.index_offset = names_offset + _names.size();
+		_stream.write_at(header.index_offset, _index.data(), _index.size() * sizeof(pack_index_entry));
+		_stream.write_at(0, &header, sizeof(header));
+
+		_stream.close();
+		_open = false;
+	}
+
+	pack_reader::pack_reader(const char* path)
+	{
+		size_t size = 0;
+		const uint8_t* data = map_file(path, size);
+		_data = data;
+		_size = size;
+		_mapped = true;
+		load(data, size);
+	}
+
+	pack_reader::pack_reader(const uint8_t* data, size_t size)
+	{
+		_data = data;
+		_size = size;
+		load(data, size);
+	}
+
+	pack_reader::~pack_reader()
+	{
+		unmap();
+	}
+
+	pack_reader::pack_reader(pack_reader&& other)
+		: _data(other._data)
+		, _size(other._size)
+		, _mapped(other._mapped)
+		, _entries(std::move(other._entries))
+		, _names(std::move(other._names))
+	{
+		other._data = nullptr;
+		other._size = 0;
+		other._mapped = false;
+	}
+
+	pack_reader& pack_reader::operator=(pack_reader&& other)
+	{
+		if (this != &other)
+		{
+			unmap();
+			std::swap(_data, other._data);
+			std::swap(_size, other._size);
+			std::swap(_mapped, other._mapped);
+			_entries = std::move(other._entries);
+			_names = std::move(other._names);
+		}
+		return *this;
+	}
+
+	void pack_reader::unmap()
+	{
+		if (_mapped)
+			unmap_file(_data, _size);
+		_data = nullptr;
+		_size = 0;
+		_mapped = false;
+	}
+
+	void pack_reader::load(const uint8_t* data, size_t size)
+	{
+		try
+		{
+			pack_header header;
+			if (size < sizeof(header))
+				throw exception(error_code::bad_header, "Pack is too small.");
+			memcpy(&header, data, sizeof(header));
+			if (memcmp(header.magic, pack_magic, sizeof(pack_magic)) != 0 || header.version != pack_version)
+				throw exception(error_code::bad_magic, "File is not a pack.");
+			if (header.count > size / sizeof(pack_index_entry) || !within(header.index_offset, header.count * sizeof(pack_index_entry), size))
+				throw exception(error_code::bad_header, "Pack index is out of the file.");
+
+			_entries.resize((size_t)header.count);
+			_names.reserve((size_t)header.count);
+			for (size_t i = 0; i < _entries.size(); ++i)
+			{
+				pack_index_entry index;
+				memcpy(&index, data + header.index_offset + i * sizeof(index), sizeof(index));
+				if (!within(index.offset, index.size, header.index_offset) || !within(index.name_offset, index.name_size, header.index_offset))
+					throw exception(error_code::bad_header, "Pack entry " + std::to_string(i) + " is out of the file.");
+
+				pack_entry& entry = _entries[i];
+				entry.data = data + index.offset;
+				entry.size = (size_t)index.size;
+				entry.name.assign(reinterpret_cast<const char*>(data) + index.name_offset, (size_t)index.name_size);
+				if (!is_relative_name(entry.name))
+					throw exception(error_code::bad_header, "Pack entry " + std::to_string(i) + " has a name that is not a relative path.");
+				_names.emplace(entry.name, i);
+			}
+		}
+		catch (...)
+		{
+			unmap();
+			throw;
+		}
+	}
+
+	size_t pack_reader::find(const std::string& name) const
+	{
+		const auto found = _names.find(name);
+		return found == _names.end() ? npos : found->second;
+	}
+
+	memory_input_stream pack_reader::stream(size_t index) const
+	{
+		const pack_entry& item = _entries.at(index);
+		return memory_input_stream(item.data, item.size);
+	}
+
+	image pack_reader::read(size_t index, const decode_limits& limits) const
+	{
+		memory_input_stream input = stream(index);
+		reader decoder(input);
+		decoder.set_limits(limits);
+		decoder.read();
+		return decoder.take_image();
+	}
+
+	void pack_reader::read(size_t index, const decode_target& target, const decode_limits& limits) const
+	{
+		memory_input_stream input = stream(index);
+		reader decoder(input);
+		decoder.set_limits(limits);
+		decoder.read(target);
+	}
+
+	status pack_reader::try_read(size_t index, const decode_target& target, const decode_limits& limits) const noexcept
+	{
+		if (index >= _entries.size())
+			return status(error_code::invalid_argument, "Pack entry " + std::to_string(index) + " does not exist.");
+		memory_input_stream input(_entries[index].data, _entries[index].size);
+		reader decoder(input);
+		decoder.set_limits(limits);
+		return decoder.try_read(target);
+	}
+
+	void pack_reader::read_all(size_t threads, const std::function<void(size_t index, image& img)>& body, const decode_limits& limits) const
+	{
+		parallel_for(_entries.size(), threads, [&](size_t i)
+		{
+			image img = read(i, limits);
+			body(i, img);
+		});
+	}
+
+}
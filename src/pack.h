@@ -0,0 +1,117 @@
+
+#pragma once
+#ifndef FBMP_PACK_H
+#define FBMP_PACK_H
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <functional>
+#include <unordered_map>
+
+#include "stream.h"
+#include "memory_stream.h"
+#include "image.h"
+#include "decode_target.h"
+#include "decode_limits.h"
+
+namespace fbmp
+{
+
+	//pack file: header, the bmp files one after another, their names, then the index
+	struct pack_header
+	{
+		char magic[4];			//FBPK
+		uint32_t version;
+		uint64_t count;
+		uint64_t index_offset;
+	};
+
+	struct pack_index_entry
+	{
+		uint64_t offset;		//bmp bytes
+		uint64_t size;
+		uint64_t name_offset;	//name bytes, not terminated
+		uint64_t name_size;
+	};
+
+	//streams bmp files into a pack, finish writes the names and the index
+	class pack_writer
+	{
+	public:
+		explicit pack_writer(positional_output_stream& stream);
+		~pack_writer();
+
+		pack_writer(const pack_writer&) = delete;
+		pack_writer& operator=(const pack_writer&) = delete;
+
+		void add(const std::string& name, const uint8_t* data, size_t size);
+		//copies a whole stream with a known size()
+		void add(const std::string& name, input_stream& bmp);
+		void finish();
+
+		size_t count() const { return _index.size(); }
+
+	private:
+		positional_output_stream& _stream;
+		std::vector<pack_index_entry> _index;
+		std::string _names;
+		uint64_t _offset = 0;
+		bool _open = false;
+	};
+
+	struct pack_entry
+	{
+		const uint8_t* data;
+		size_t size;
+		std::string name;	//relative path, never absolute and without .. components
+	};
+
+	//a pack mapped once, entries are handed out as spans of the mapping
+	//every const member may be called from several threads at once
+	class pack_reader
+	{
+	public:
+		static const size_t npos = SIZE_MAX;
+
+		pack_reader() = default;
+		explicit pack_reader(const char* path);
+		//caller owned bytes that outlive the reader
+		pack_reader(const uint8_t* data, size_t size);
+		~pack_reader();
+
+		pack_reader(pack_reader&& other);
+		pack_reader& operator=(pack_reader&& other);
+		pack_reader(const pack_reader&) = delete;
+		pack_reader& operator=(const pack_reader&) = delete;
+
+		size_t size() const { return _entries.size(); }
+		const pack_entry& entry(size_t index) const { return _entries[index]; }
+		size_t find(const std::string& name) const;
+
+		//zero-copy stream over one entry, valid as long as the reader
+		memory_input_stream stream(size_t index) const;
+
+		image read(size_t index, const decode_limits& limits = decode_limits()) const;
+		void read(size_t index, const decode_target& target, const decode_limits& limits = decode_limits()) const;
+		status try_read(size_t index, const decode_target& target, const decode_limits& limits = decode_limits()) const noexcept;
+
+		//decodes every entry on up to threads threads, body runs on the decoding thread and may take the image
+		//the first failing entry stops the rest and its error is rethrown
+		void read_all(size_t threads, const std::function<void(size_t index, image& img)>& body, const decode_limits& limits = decode_limits()) const;
+
+	private:
+		void load(const uint8_t* data, size_t size);
+		void unmap();
+
+		const uint8_t* _data = nullptr;
+		size_t _size = 0;
+		bool _mapped = false;
+		std::vector<pack_entry> _entries;
+		std::unordered_map<std::string, size_t> _names;
+	};
+
+}
+
+#endif //FBMP_PACK_H
@@ -0,0 +1,75 @@
+
+#pragma once
+#ifndef FBMP_PARALLEL_H
+#define FBMP_PARALLEL_H
+
+//internal header: splitting independent work items between threads
+
+#include <mutex>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <exception>
+#include <system_error>
+
+namespace fbmp
+{
+
+	//runs body(0) ... body(count - 1) on up to threads threads, the calling thread included
+	//the first exception thrown by a body stops the remaining items and is rethrown to the caller
+	template <typename Body>
+	void parallel_for(size_t count, size_t threads, const Body& body)
+	{
+		threads = std::min(threads, count);
+		if (threads <= 1)
+		{
+			for (size_t i = 0; i < count; ++i)
+				body(i);
+			return;
+		}
+
+		std::atomic<size_t> next(0);
+		std::exception_ptr error;
+		std::mutex error_mutex;
+
+		auto worker = [&]()
+		{
+			for (size_t i = next++; i < count; i = next++)
+			{
+				try
+				{
+					body(i);
+				}
+				catch (...)
+				{
+					std::lock_guard<std::mutex> lock(error_mutex);
+					if (!error)
+						error = std::current_exception();
+					next = count;
+				}
+			}
+		};
+
+		//threads the system can not start leave their items to the ones running, the calling thread always runs
+		std::vector<std::thread> workers;
+		workers.reserve(threads - 1);
+		try
+		{
+			for (size_t t = 1; t < threads; ++t)
+				workers.emplace_back(worker);
+		}
+		catch (const std::system_error&)
+		{
+		}
+		worker();
+		for (std::thread& t : workers)
+			t.join();
+
+		if (error)
+			std::rethrow_exception(error);
+	}
+
+}
+
+#endif //FBMP_PARALLEL_H
@@ -0,0 +1,223 @@
+
+#include <cstring>
+#include <algorithm>
+#include "push_decoder.h"
+#include "decode_kernels.h"
+
+namespace fbmp
+{
+
+	push_decoder::push_decoder(row_callback on_row, row_order order)
+		: _on_row(std::move(on_row))
+		, _order(order)
+		, _table(new palette_table())
+	{
+		reset();
+	}
+
+	push_decoder::~push_decoder()
+	{
+	}
+
+	void push_decoder::reset()
+	{
+		_header = main_header();
+		memset(&_info, 0, sizeof(_info));
+		memset(_palette, 0, sizeof(_palette));
+		_channels = 0;
+		_unpack = nullptr;
+		_rows = 0;
+		_buffered = false;
+		_position = 0;
+		_reservation.release();
+		start(step::main_header, sizeof(main_header));
+	}
+
+	void push_decoder::feed(const uint8_t* data, size_t size)
+	{
+		while (size && _step != step::done)
+		{
+			//whole rows are decoded straight from the caller's bytes
+			if (_step == step::rows && _filled == 0 && size >= _need)
+			{
+				decode_row(data);
+				data += _need;
+				size -= _need;
+				_position += _need;
+				continue;
+			}
+
+			const size_t count = std::min(size, _need - _filled);
+			if (_step != step::gap)
+				_pending.insert(_pending.end(), data, data + count);
+			_filled += count;
+			_position += count;
+			data += count;
+			size -= count;
+
+			if (_filled == _need)
+				finish_step(_pending.data());
+		}
+	}
+
+	void push_decoder::start(step next, size_t size)
+	{
+		_step = next;
+		_need = size;
+		_filled = 0;
+		_pending.clear();
+
+		if (_need == 0 && _step != step::done)
+			finish_step(nullptr);
+	}
+
+	void push_decoder::finish_step(const uint8_t* data)
+	{
+		switch (_step)
+		{
+		case step::main_header:
+			memcpy(&_header, data, sizeof(main_header));
+			if (_header.magic[0] != 'B' || _header.magic[1] != 'M')
+				throw exception(error_code::bad_magic, std::string("Bad magic number. The file should begin from: BM. Readed: ") + std::string(_header.magic, _header.magic + 2));
+			start(step::dib_size, sizeof(int32_t));
+			break;
+
+		case step::dib_size:
+		{
+			//data points into _pending, which start clears
+			uint8_t size_field[sizeof(int32_t)];
+			memcpy(size_field, data, sizeof(size_field));
+			int32_t dib_header_size;
+			memcpy(&dib_header_size, size_field, sizeof(int32_t));
+			if (dib_header_size < (int32_t)sizeof(int32_t) || dib_header_size > bmp_info::max_header_size)
+				throw exception(error_code::bad_header, std::string("Unsuppoerted bitmap dib header size - ") + std::to_string(dib_header_size));
+
+			//the size field is parsed together with the rest of the header
+			start(step::dib_header, dib_header_size);
+			_pending.assign(size_field, size_field + sizeof(size_field));
+			_filled = sizeof(int32_t);
+			if (_filled == _need)
+				finish_step(_pending.data());
+			break;
+		}
+
+		case step::dib_header:
+		{
+			_info = bmp_info::parse(data, (int32_t)_need);
+			throw_if_error(check_header_limits(_info, _limits));
+
+			//the format is checked before the palette is sized, 32bpp bitfields once their masks that follow a 40 byte header are read
+			const bool trailing_masks = _info.bit_count == 32 && _info.trailing_mask_bytes();
+			if (!trailing_masks)
+				throw_if_error(check_pixel_format(_info));
+
+			size_t palette_bytes = trailing_masks ? _info.trailing_mask_bytes() : 0;
+			if (_info.bit_count <= 8)
+			{
+				size_t palette_size = (uint8_t)_info.palette_colors;
+				if (palette_size == 0)
+					palette_size = (size_t)1 << _info.bit_count;
+				palette_bytes = std::min<size_t>(palette_size, 256) * _info.palette_entry_size();
+			}
+			start(step::palette, palette_bytes);
+			break;
+		}
+
+		case step::palette:
+		{
+			const size_t entry_size = _info.palette_entry_size();
+			if (_info.bit_count > 8 && _need)
+			{
+				_info.parse_trailing_masks(data);
+				throw_if_error(check_pixel_format(_info));
+			}
+			for (size_t i = 0; _info.bit_count <= 8 && i < _need / entry_size; ++i)
+			{
+				const uint8_t* entry = data + i * entry_size;
+				_palette[i] = entry[0] | (entry[1] << 8) | (entry[2] << 16) | (entry_size == 4 ? (uint32_t)entry[3] << 24 : 0);
+			}
+
+			const uint64_t offset = _header.offset;
+			if (offset < _position)
+				throw exception(error_code::bad_header, "Pixel data overlaps the headers.");
+			start(step::gap, (size_t)(offset - _position));
+			break;
+		}
+
+		case step::gap:
+			start_pixels();
+			break;
+
+		case step::rows:
+			decode_row(data);
+			break;
+
+		case step::done:
+			break;
+		}
+	}
+
+	void push_decoder::start_pixels()
+	{
+		const int32_t bit_count = _info.bit_count;
+		throw_if_error(check_pixel_format(_info));
+
+		const size_t width = _info.width;
+		const size_t height = _info.abs_height();
+		_channels = bit_count == 32 ? 4 : bit_count == 1 && is_black_white(_palette) ? 1 : 3;
+		_unpack = select_row_kernel(bit_count, _channels == 1);
+		_table->assign(_palette);
+
+		_buffered = (_order == row_order::top_down && _info.flipped()) || (_order == row_order::bottom_up && !_info.flipped());
+		if (_buffered)
+		{
+			const uint64_t bytes = (uint64_t)width * _channels * height;
+			if (bytes > _limits.max_bytes)
+				throw exception(error_code::limit_exceeded, std::string("Image of ") + std::to_string(bytes) + " bytes exceeds the memory limit.");
+			if (!_reservation.acquire(_limits.budget, bytes))
+			{
+				_image = image();
+				throw exception(error_code::limit_exceeded, std::string("Image of ") + std::to_string(bytes) + " bytes does not fit the memory budget.");
+			}
+			_image.reset(width, height, _channels);
+		}
+		else
+		{
+			_row.resize(width * _channels);
+		}
+
+		start(step::rows, _info.row_size());
+	}
+
+	void push_decoder::decode_row(const uint8_t* line)
+	{
+		const size_t width = _info.width;
+		const size_t height = _info.abs_height();
+		const size_t y = _info.flipped() ? height - 1 - _rows : _rows;
+
+		uint8_t* row = _buffered ? _image.get_row_begin(y) : _row.data();
+		_unpack(line, row, (int)width, *_table);
+		++_rows;
+
+		if (!_buffered)
+			_on_row(y, row);
+
+		if (_rows < height)
+		{
+			start(step::rows, _need);
+			return;
+		}
+
+		start(step::done, 0);
+		if (_buffered)
+		{
+			for (size_t i = 0; i < height; ++i)
+			{
+				const size_t emitted = _order == row_order::top_down ? i : height - 1 - i;
+				_on_row(emitted, _image.get_row_begin(emitted));
+			}
+			_reservation.release();
+		}
+	}
+
+}
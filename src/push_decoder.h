@@ -0,0 +1,97 @@
+
+#pragma once
+#ifndef FBMP_PUSH_DECODER_H
+#define FBMP_PUSH_DECODER_H
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <memory>
+#include <functional>
+
+#include "data_types.h"
+#include "image.h"
+#include "decode_target.h"
+#include "decode_limits.h"
+
+namespace fbmp
+{
+
+	struct palette_table;
+
+	//y counts from the top, row holds width * channels() bytes of R, G, B(, A) or gray like the reader's image
+	typedef std::function<void(size_t y, const uint8_t* row)> row_callback;
+
+	//decoder driven by the caller, for bytes that arrive in chunks of any size
+	//row_order::keep emits every row as soon as its bytes are complete, bottom-up files then go from the last row up
+	//any other order emits rows as they complete when the file already has that order, otherwise the
+	//pixels are kept in an image and all rows are emitted in the requested order once the last one arrives
+	class push_decoder
+	{
+	public:
+		push_decoder(row_callback on_row, row_order order = row_order::keep);
+		~push_decoder();
+
+		//consumes all bytes without blocking, bytes after the last row are ignored
+		void feed(const uint8_t* data, size_t size);
+
+		//starts over with a new file, buffers are kept for reuse
+		void reset();
+
+		void set_limits(const decode_limits& limits) { _limits = limits; }
+
+		bool header_ready() const { return _step > step::dib_header; }
+		bool done() const { return _step == step::done; }
+		size_t rows_decoded() const { return _rows; }
+
+		//valid once header_ready
+		const main_header& get_main_header() const { return _header; }
+		const bmp_info& get_info() const { return _info; }
+		//valid once the palette has arrived, before the first row
+		size_t channels() const { return _channels; }
+
+	private:
+		enum class step
+		{
+			main_header,
+			dib_size,
+			dib_header,
+			palette,
+			gap,		//bytes between the palette and the pixels
+			rows,
+			done
+		};
+
+		void start(step next, size_t size);
+		void finish_step(const uint8_t* data);
+		void start_pixels();
+		void decode_row(const uint8_t* line);
+
+	private:
+		row_callback _on_row;
+		row_order _order;
+		decode_limits _limits;
+
+		step _step;
+		size_t _need;				//bytes of the current step
+		size_t _filled;				//bytes of the current step seen so far
+		uint64_t _position;			//bytes consumed from the start of the file
+		std::vector<uint8_t> _pending;	//current step when it spans several feeds
+
+		main_header _header;
+		bmp_info _info;
+		uint32_t _palette[256];
+		std::unique_ptr<palette_table> _table;
+		void (*_unpack)(const uint8_t* line, uint8_t* row, int width, const palette_table& palette);
+		size_t _channels;
+		size_t _rows;
+
+		bool _buffered;				//rows are collected in _image and emitted at the end
+		std::vector<uint8_t> _row;
+		image _image;
+		budget_reservation _reservation;	//bytes of _image
+	};
+
+}
+
+#endif //FBMP_PUSH_DECODER_H
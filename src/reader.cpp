@@ -1,410 +1,871 @@
 
+#include <new>
 #include <memory>
 #include <cassert>
+#include <cstring>
 #include "reader.h"
+#include "convert.h"
+#include "decode_kernels.h"
 
 
 namespace fbmp
 {
-	class input_stream_handle
+	reader::reader()
+		: _stream(nullptr)
 	{
-	public:
-		input_stream_handle(input_stream& stream)
-			: m_stream(stream)
-		{
-			m_stream.open_for_reading();
-		}
+		memset(&_info, 0, sizeof(_info));
+	}
+
+	reader::reader(input_stream& stream)
+		: reader()
+	{
+		_stream = &stream;
+	}
+
+	reader::reader(input_stream* stream)
+		: reader()
+	{
+		_stream = stream;
+	}
+
+	void reader::reset(input_stream& stream)
+	{
+		_stream = &stream;
+		_header = main_header();
+		memset(&_info, 0, sizeof(_info));
+	}
 
-		input_stream_handle(const input_stream_handle&) = delete;
-		input_stream_handle& operator=(const input_stream_handle&) = delete;
+	reader::~reader()
+	{
+	}
 
-		~input_stream_handle()
+	namespace
+	{
+		//decode steps past the header checks still throw on I/O failures, the status API catches them here
+		template <typename Step>
+		status guarded(const Step& step) noexcept
 		{
-			m_stream.close();
+			try
+			{
+				step();
+				return status();
+			}
+			catch (const exception& e)
+			{
+				return status(e.code(), e.what());
+			}
+			catch (const std::bad_alloc&)
+			{
+				return status(error_code::out_of_memory, "Out of memory.");
+			}
+			catch (const std::exception& e)
+			{
+				return status(error_code::unknown, e.what());
+			}
 		}
+	}
 
-	private:
-		input_stream& m_stream;
-	};
+	void reader::read()
+	{
+		throw_if_error(try_read());
+	}
 
-	reader::reader(input_stream& stream)
-		: _stream(stream)
+	void reader::read(const decode_target& target)
 	{
-		
+		throw_if_error(try_read(target));
 	}
 
-	reader::reader(input_stream* stream)
-		: _stream(*stream)
+	void reader::read_info()
 	{
-		
+		throw_if_error(try_read_info());
 	}
 
-	reader::~reader()
+	status reader::try_read() noexcept
 	{
+		if (!_stream)
+			return status(error_code::invalid_argument, "Reader has no input stream.");
+		input_stream_handle streamHandle(*_stream, std::nothrow);
+
+		status result = streamHandle.get_status();
+		if (result)
+			result = try_read_header();
+		if (result)
+			result = try_read_dib_header();
+		if (result)
+			result = try_read_image();
+		return result;
 	}
 
-	void reader::read()
+	status reader::try_read(const decode_target& target) noexcept
 	{
-		input_stream_handle streamHandle(_stream);
+		if (!_stream)
+			return status(error_code::invalid_argument, "Reader has no input stream.");
+		input_stream_handle streamHandle(*_stream, std::nothrow);
+
+		status result = streamHandle.get_status();
+		if (result)
+			result = try_read_header();
+		if (result)
+			result = try_read_dib_header();
+		if (result)
+			result = try_read_image(target);
+		return result;
+	}
 
-		read_header();
-		read_dib_header();
+	status reader::try_read_info() noexcept
+	{
+		if (!_stream)
+			return status(error_code::invalid_argument, "Reader has no input stream.");
+		input_stream_handle streamHandle(*_stream, std::nothrow);
+
+		status result = streamHandle.get_status();
+		if (result)
+			result = try_read_header();
+		if (result)
+			result = try_read_dib_header();
+		if (result)
+			result = try_read_palette();
+		return result;
+	}
 
-		read_image();
+	size_t reader::output_channels() const
+	{
+		const int16_t bit_count = _info.bit_count;
+		if (bit_count == 32)
+			return 4;
+		if (bit_count == 1 && is_palette_black_white())
+			return 1;
+		return 3;
 	}
 
 
 	void reader::read_header()
 	{
-		_stream.read(&_header, sizeof(main_header), 1);
+		throw_if_error(try_read_header());
+	}
+
+	void reader::read_dib_header()
+	{
+		throw_if_error(try_read_dib_header());
+	}
+
+	void reader::read_palette()
+	{
+		throw_if_error(try_read_palette());
+	}
+
+	status reader::try_read_header() noexcept
+	{
+		status result = _stream->try_read(&_header, sizeof(main_header), 1);
+		if (!result)
+			return result;
 		if (_header.magic[0] != 'B' || _header.magic[1] != 'M')
 		{
-			throw exception(std::string("Bad magic number. The file should begin from: BM. Readed: ") + std::string(_header.magic, _header.magic + 2));
+			return status(error_code::bad_magic, std::string("Bad magic number. The file should begin from: BM. Readed: ") + std::string(_header.magic, _header.magic + 2));
 		}
+		return status();
 	}
 
-	void reader::read_dib_header()
+	status reader::try_read_dib_header() noexcept
 	{
+		uint8_t header[bmp_info::max_header_size];
 		int32_t dib_header_size;
-		_stream.read(&dib_header_size, sizeof(int32_t), 1);
-		_dib_header = dib_header::create_header(dib_header_size);
-		_stream.read(_dib_header->data(), dib_header_size - sizeof(int32_t), 1);
-		
+		status result = _stream->try_read(&dib_header_size, sizeof(int32_t), 1);
+		if (!result)
+			return result;
+		if (dib_header_size != 12 && (dib_header_size < 16 || dib_header_size > bmp_info::max_header_size))
+			return status(error_code::bad_header, std::string("Unsuppoerted bitmap dib header size - ") + std::to_string(dib_header_size));
+
+		memcpy(header, &dib_header_size, sizeof(int32_t));
+		result = _stream->try_read(header + sizeof(int32_t), dib_header_size - sizeof(int32_t), 1);
+		if (!result)
+			return result;
+		_info = bmp_info::parse(header, dib_header_size);
+		if (const size_t mask_bytes = _info.trailing_mask_bytes())
+		{
+			result = _stream->try_read(header, mask_bytes, 1);
+			if (!result)
+				return result;
+			_info.parse_trailing_masks(header);
+		}
+		return check_limits();
 	}
 
-	void reader::read_palette()
+	status reader::check_limits() const
+	{
+		status result = check_header_limits(_info, _limits);
+		if (!result)
+			return result;
+
+		//uncompressed pixels past the end of the stream
+		const uint64_t stream_size = _stream ? _stream->size() : 0;
+		if (stream_size && (_info.compression == 0 || _info.compression == 3)
+			&& (uint64_t)_header.offset + _info.row_bytes() * _info.abs_height() > stream_size)
+			return status(error_code::read_failed, "Pixel data is truncated.");
+		return status();
+	}
+
+	status reader::check_format() const
+	{
+		return check_pixel_format(_info);
+	}
+
+	status reader::try_read_palette() noexcept
 	{
 		memset(_palette, 0, 256 * sizeof(uint32_t));
 
-		int16_t bit_count = _dib_header->bit_count();
+		int16_t bit_count = _info.bit_count;
 		if (bit_count > 8)
-			return;
+			return status();
+		if (bit_count < 1)
+			return check_format();
 
-		int palette_size = (uint8_t)_dib_header->palette_colors();
+		int palette_size = (uint8_t)_info.palette_colors;
 		if (palette_size == 0)
 			palette_size = (1 << bit_count);
 		
-		if (_dib_header->header_type() != dib_header_type::bitmap_core_header)
+		if (_info.palette_entry_size() == sizeof(uint32_t))
 		{
-			_stream.read(_palette, sizeof(uint32_t), palette_size);
+			return _stream->try_read(_palette, sizeof(uint32_t), palette_size);
 		}
 		else // old bitmap format
 		{
-			assert(_dib_header->size() == 12);
+			assert(_info.header_size == 12);
 			struct pixel3
 			{
 				uint8_t x;	uint8_t y;	uint8_t z;
 			};
 
 			pixel3 pixel3_palette[256];
-			_stream.read(pixel3_palette, sizeof(pixel3), palette_size);
+			status result = _stream->try_read(pixel3_palette, sizeof(pixel3), palette_size);
+			if (!result)
+				return result;
 
 			for (int i = 0; i < palette_size; ++i)
 				_palette[i] = (pixel3_palette[i].x) + (pixel3_palette[i].y << 8) + (pixel3_palette[i].z << 16);
 		}
+		return status();
 	}
 
-	bool reader::is_palette_black_white()
+	bool reader::is_palette_gray() const
 	{
-		return _palette[0] == 0 && _palette[1] == 0xFFFFFF;
+		if (_info.bit_count > 8)
+			return false;
+		for (int i = 0; i < 256; ++i)
+		{
+			const uint32_t entry = _palette[i];
+			if (((entry >> 16) & 0xFF) != (entry & 0xFF) || ((entry >> 8) & 0xFF) != (entry & 0xFF))
+				return false;
+		}
+		return true;
 	}
 
-	void reader::read_1bpp(int width, int height, int row_size, bool flipped)
+	bool reader::is_palette_black_white() const
 	{
-		_stream.seek(_header.offset);
-		std::unique_ptr<uint8_t[]> line_buffer(new uint8_t[row_size]);
-
-		int	row = flipped ? height - 1 : 0;
-		const int inc = flipped ? -1 : 1;
-		const int end = flipped ? -1 : height - 1;
+		return is_black_white(_palette);
+	}
 
-		if (is_palette_black_white())
+	namespace
+	{
+		//whole file rows, padding included, may be read into the target: a caller's pixels right of the image stay untouched
+		bool fits_file_rows(const sample_rows& out, const decode_geometry& g, size_t channels)
 		{
-			_image.reset(width, height, 1);
-			for (; row != end; row += inc)
-			{
-				int streamPos = 0;
-				uint8_t* data = _image.get_row_begin(row);
-				const uint8_t* const data_end = data + width;
+			return out.pitch == (size_t)g.row_size && (out.scratch_padding || (size_t)g.row_size == (size_t)g.width * channels);
+		}
 
-				_stream.read(line_buffer.get(), sizeof(uint8_t), row_size);
+		template <int BitCount, bool BlackWhite, bool Flipped>
+		void decode_source(input_stream& stream, const decode_geometry& g, const sample_rows& out, bool interleaved, rotation angle, const palette_table& palette)
+		{
+			enum { channels = source_channels<BitCount, BlackWhite>::value };
+			typedef interleaved_rows<channels> interleaved_type;
+			typedef planar_rows<channels> planar_type;
 
-				while (data < data_end - 8)
+			interleaved = interleaved || channels == 1;
+			if (out.type == sample_type::u8)
+			{
+				if (!interleaved)
 				{
-					uint8_t value = line_buffer[streamPos++];
-					data[0] = ((value >> 7) & 1) * 255;
-					data[1] = ((value >> 6) & 1) * 255;
-					data[2] = ((value >> 5) & 1) * 255;
-					data[3] = ((value >> 4) & 1) * 255;
-					data[4] = ((value >> 3) & 1) * 255;
-					data[5] = ((value >> 2) & 1) * 255;
-					data[6] = ((value >> 1) & 1) * 255;
-					data[7] = ((value >> 0) & 1) * 255;
-					data += 8;
+					const planar_type rows = { out.data, out.pitch, out.plane_stride };
+					decode_rows<BitCount, BlackWhite, Flipped>(stream, g, rows, palette, out.stats);
 				}
-
-				if (data < data_end)
+				else if (angle != rotation::none)
 				{
-					uint8_t value = line_buffer[streamPos];
-					for (int k = 7; data < data_end; --k)
-					{
-						*data++ = ((value >> k) & 1) * 255;
-					}
+					const int band = 32;
+					const size_t band_pitch = (size_t)g.width * channels;
+					std::unique_ptr<uint8_t[]> band_buffer(new uint8_t[band_pitch * band]);
+
+					rotated_rows<channels> rows;
+					rows.data = band_buffer.get();
+					rows.pitch = band_pitch;
+					rows.hash = out.hash;
+					rows.target = angle == rotation::rotate_180 ? image_view(out.data, g.width, g.height, channels, out.pitch)
+						: image_view(out.data, g.height, g.width, channels, out.pitch);
+					rows.angle = angle;
+					rows.height = g.height;
+					rows.band = band;
+					rows.flipped = Flipped;
+					decode_rows<BitCount, BlackWhite, Flipped>(stream, g, rows, palette, out.stats);
+				}
+				else if (out.streaming)
+				{
+					std::unique_ptr<uint8_t[]> scratch(new uint8_t[(size_t)g.width * channels]);
+
+					streamed_rows<interleaved_type> rows;
+					rows.data = scratch.get();
+					rows.pitch = 0;
+					rows.hash = out.hash;
+					rows.target = out.data;
+					rows.target_pitch = out.pitch;
+					rows.row_bytes = (size_t)g.width * channels;
+					decode_rows<BitCount, BlackWhite, Flipped>(stream, g, rows, palette, out.stats);
+					stream_fence();
+				}
+				else if (BitCount >= 24 && fits_file_rows(out, g, channels))
+				{
+					decode_in_place<BitCount >= 24 ? channels : 3, Flipped>(stream, g, out.data, out.pitch, out.hash, out.stats);
+				}
+				else
+				{
+					const interleaved_type rows = { out.data, out.pitch, out.hash };
+					decode_rows<BitCount, BlackWhite, Flipped>(stream, g, rows, palette, out.stats);
 				}
+				return;
+			}
+
+			std::unique_ptr<uint8_t[]> scratch(new uint8_t[g.width * channels]);
+			if (interleaved)
+			{
+				converted_rows<interleaved_type> rows;
+				rows.data = scratch.get();
+				rows.pitch = 0;
+				rows.hash = out.hash;
+				rows.target = out;
+				decode_rows<BitCount, BlackWhite, Flipped>(stream, g, rows, palette, out.stats);
+			}
+			else
+			{
+				converted_rows<planar_type> rows;
+				rows.data = scratch.get();
+				rows.pitch = 0;
+				rows.plane_stride = g.width;
+				rows.target = out;
+				decode_rows<BitCount, BlackWhite, Flipped>(stream, g, rows, palette, out.stats);
 			}
 		}
-		else
+
+		//the only runtime dispatch of a decode, everything below it is specialised
+		template <bool Flipped>
+		void decode_bit_count(input_stream& stream, int32_t bit_count, bool black_white, const decode_geometry& g, const sample_rows& out, bool interleaved, rotation angle, const palette_table& palette)
 		{
-			_image.reset(width, height, 3);
-			for (; row != end; row += inc)
+			switch (bit_count)
 			{
-				uint8_t* data = _image.get_row_begin(row);
-				const uint8_t* const data_end = data + width * 3;
-				_stream.read(line_buffer.get(), sizeof(uint8_t), row_size);
-				int streamPos = 0;
-				while (data < data_end)
-				{
-					uint8_t value = line_buffer[streamPos];
-					for (int k = 7; data < data_end && k >= 0; --k)
-					{
-						int color = _palette[((value >> k) & 1)];
-						data[0] = (uint8_t)(color >> 16);
-						data[1] = (uint8_t)(color >> 8);
-						data[2] = (uint8_t)color;
-						data += 3;
-					}
-					++streamPos;
-				}
+			case 1:
+				if (black_white)
+					decode_source<1, true, Flipped>(stream, g, out, interleaved, angle, palette);
+				else
+					decode_source<1, false, Flipped>(stream, g, out, interleaved, angle, palette);
+				break;
+			case 4:
+				decode_source<4, false, Flipped>(stream, g, out, interleaved, angle, palette);
+				break;
+			case 8:
+				decode_source<8, false, Flipped>(stream, g, out, interleaved, angle, palette);
+				break;
+			case 24:
+				decode_source<24, false, Flipped>(stream, g, out, interleaved, angle, palette);
+				break;
+			case 32:
+				decode_source<32, false, Flipped>(stream, g, out, interleaved, angle, palette);
+				break;
+			default:
+				throw exception(error_code::unsupported_format, std::string("not supported bpp ") + std::to_string(bit_count));
 			}
 		}
+
+		//average of count raw chroma contributions, rounded and moved to the video range
+		uint8_t chroma_value(int32_t sum, int32_t count)
+		{
+			const int32_t average = (sum + (sum >= 0 ? count / 2 : -count / 2)) / count;
+			const int32_t value = ((average + 128) >> 8) + 128;
+			return (uint8_t)(value < 0 ? 0 : value > 255 ? 255 : value);
+		}
 	}
 
-	void reader::read_4bpp(int width, int height, int row_size, bool flipped)
+	void reader::read_image()
 	{
-		_image.reset(width, height, 3);
-		_stream.seek(_header.offset);
+		throw_if_error(try_read_image());
+	}
 
-		std::unique_ptr<uint8_t[]> line_buffer(new uint8_t[row_size]);
-		int	row = flipped ? height - 1 : 0;
-		const int inc = flipped ? -1 : 1;
-		const int end = flipped ? -1 : height - 1;
+	void reader::read_image(const decode_target& target)
+	{
+		throw_if_error(try_read_image(target));
+	}
 
-		for (; row != end; row += inc)
+	void reader::decode_image(const decode_target& target)
+	{
+		throw_if_error(try_decode_image(target));
+	}
+
+	status reader::try_read_image() noexcept
+	{
+		status result = try_read_palette();
+		if (result)
+			result = check_format();
+		if (result)
+			result = guarded([&]() { decode_native(); });
+		return result;
+	}
+
+	status reader::try_read_image(const decode_target& target) noexcept
+	{
+		status result = try_read_palette();
+		if (result)
+			result = try_decode_image(target);
+		return result;
+	}
+
+	status reader::try_decode_image(const decode_target& target) noexcept
+	{
+		status result = check_format();
+		if (result)
+			result = guarded([&]() { decode_pixels(target); });
+		return result;
+	}
+
+	void reader::decode_native()
+	{
+		const int32_t width = _info.width;
+		const int32_t height = _info.abs_height();
+		const int32_t bit_count = _info.bit_count;
+		const bool indexed = _indexed_output && bit_count <= 8;
+		const size_t channels = indexed ? 1 : output_channels();
+		const int row_size = _info.row_size();
+
+		if (indexed && _hash_enabled)
+			throw exception(error_code::invalid_argument, "Content hash needs interleaved native output.");
+
+		//24bpp and indexed 8bpp keep the file row padding so the pixels can be read with a single call,
+		//large images stream their rows instead
+		const bool large = (uint64_t)width * channels * height >= _large_threshold;
+		const bool padded = (bit_count == 24 || (indexed && bit_count == 8)) && !large;
+		const size_t pitch = padded ? (size_t)row_size : width * channels;
+
+		const uint64_t bytes = (uint64_t)pitch * height;
+		if (bytes > _limits.max_bytes)
+			throw exception(error_code::limit_exceeded, std::string("Image of ") + std::to_string(bytes) + " bytes exceeds the memory limit.");
+		if (!_reservation.acquire(_limits.budget, bytes))
 		{
-			_stream.read(line_buffer.get(), sizeof(uint8_t), row_size);
-			uint8_t* begin = _image.get_row_begin(row);
-			const uint8_t* const end = _image.get_row_end(row);
-			uint8_t* data = line_buffer.get();
-			while (begin != end)
-			{
-				uint8_t value = *data;
-				uint32_t color = _palette[value >> 4];
-				begin[0] = (uint8_t)(color >> 16);
-				begin[1] = (uint8_t)(color >> 8);
-				begin[2] = (uint8_t)color;
-				begin += 3;
-
-				if (begin < end)
-				{
-					uint32_t color = _palette[value & 0xF];
-					begin[0] = (uint8_t)(color >> 16);
-					begin[1] = (uint8_t)(color >> 8);
-					begin[2] = (uint8_t)color;
-					begin += 3;
-				}
-				++data;
-			}
+			_image = image();
+			throw exception(error_code::limit_exceeded, std::string("Image of ") + std::to_string(bytes) + " bytes does not fit the memory budget.");
 		}
+
+		if (large)
+			_image.reset_large(width, height, channels, pitch, _prefault_threads);
+		else
+			_image.reset(width, height, channels, pitch);
+
+		output_rows out;
+		out.data = _image.data();
+		out.pitch = _image.pitch();
+		out.channel_stride = 1;
+		out.pixel_stride = channels;
+		out.interleaved = true;
+		out.type = sample_type::u8;
+		out.format = pixel_format::native;
+		out.rotate = rotation::none;
+		out.streaming = large;
+		out.scratch_padding = padded;
+
+		row_hash hash;
+		hash.row_bytes = width * channels;
+		out.hash = _hash_enabled ? &hash : nullptr;
+		std::unique_ptr<stats_counter> stats(_stats_enabled ? new stats_counter() : nullptr);
+		out.stats = stats.get();
+		if (indexed)
+			read_indexed_pixels(out, _palette_gray_output);
+		else
+			read_pixels(out);
+		_content_hash = _hash_enabled ? hash.digest(width, height, channels) : 0;
+		finish_stats(stats.get(), output_channels());
 	}
 
-	void reader::read_8bpp(int width, int height, int row_size, bool flipped)
+	void reader::decode_pixels(const decode_target& target)
 	{
-		_image.reset(width, height, 3);
-		_stream.seek(_header.offset);
+		const size_t width = _info.width;
+		const size_t height = _info.abs_height();
+		const bool yuv = target.format == pixel_format::i420 || target.format == pixel_format::nv12;
+		const size_t channels = target.format == pixel_format::native ? output_channels() : 1;
+		const size_t sample = sample_size(target.type);
+
+		if (yuv && target.type != sample_type::u8)
+			throw exception(error_code::invalid_argument, "YUV output supports 8-bit samples only.");
+		if (target.format == pixel_format::indexed && target.type != sample_type::u8)
+			throw exception(error_code::invalid_argument, "Indexed output supports 8-bit samples only.");
+
+		const bool rotated = target.rotate != rotation::none;
+		if (rotated && (target.type != sample_type::u8 || target.format != pixel_format::native || (target.layout != pixel_layout::interleaved && channels != 1)))
+			throw exception(error_code::invalid_argument, "Rotation needs an interleaved 8-bit native target.");
+
+		//rows of a target turned by 90 or 270 degrees are as long as the image is high
+		const bool swapped = target.rotate == rotation::rotate_90 || target.rotate == rotation::rotate_270;
+		const size_t target_width = swapped ? height : width;
+
+		output_rows out;
+		out.data = target.data;
+		out.type = target.type;
+		out.format = target.format;
+		out.rotate = target.rotate;
+		out.scratch_padding = false;
+		if (target.layout == pixel_layout::interleaved || channels == 1)
+		{
+			out.pitch = target.pitch ? target.pitch : target_width * channels * sample;
+			out.channel_stride = sample;
+			out.pixel_stride = channels * sample;
+			out.interleaved = true;
 
-		std::unique_ptr<uint8_t[]> line_buffer(new uint8_t[row_size]);
-		int	row = flipped ? height - 1 : 0;
-		const int inc = flipped	? -1 : 1;
-		const int end = flipped ? -1 : height - 1;
+			if (out.pitch < target_width * channels * sample)
+				throw exception(error_code::invalid_argument, "Pitch is too small.");
+		}
+		else
+		{
+			out.pitch = target.pitch ? target.pitch : width * sample;
+			out.channel_stride = target.plane_stride ? target.plane_stride : out.pitch * height;
+			out.pixel_stride = sample;
+			out.interleaved = false;
 
-		for (; row != end; row += inc)
+			if (out.pitch < width * sample || out.channel_stride < out.pitch * height)
+				throw exception(error_code::invalid_argument, "Plane is too small.");
+		}
+
+		if (_hash_enabled && (!out.interleaved || target.format != pixel_format::native))
+			throw exception(error_code::invalid_argument, "Content hash needs interleaved native output.");
+
+		//(x / 255 - mean) / stddev folded into x * scale + bias, laid out as the 12 entry pattern convert_samples expects
+		for (size_t c = 0; c < 4; ++c)
 		{
-			_stream.read(line_buffer.get(), sizeof(uint8_t), row_size);
-			uint8_t* begin = _image.get_row_begin(row);
-			const uint8_t* const end = _image.get_row_end(row);
-			uint8_t* data = line_buffer.get();
-			while (begin != end)
+			for (size_t i = 0; i < 12; ++i)
 			{
-				uint32_t color = _palette[*data];
-				++data;
-				begin[0] = (uint8_t)(color >> 16);
-				begin[1] = (uint8_t)(color >> 8);
-				begin[2] = (uint8_t)color;
-				begin += 3;
+				const size_t channel = out.interleaved ? i % channels : c;
+				out.scale[c][i] = 1.0f / (255.0f * target.stddev[channel]);
+				out.bias[c][i] = -target.mean[channel] / target.stddev[channel];
 			}
 		}
+
+		std::unique_ptr<stats_counter> stats(_stats_enabled ? new stats_counter() : nullptr);
+		out.stats = stats.get();
+
+		if (target.format == pixel_format::native)
+		{
+			out.streaming = out.interleaved && target.type == sample_type::u8 && !rotated
+				&& (uint64_t)out.pitch * height >= _large_threshold;
+
+			row_hash hash;
+			hash.row_bytes = width * channels;
+			out.hash = _hash_enabled ? &hash : nullptr;
+			read_pixels(out);
+			_content_hash = _hash_enabled ? hash.digest(width, height, channels) : 0;
+			finish_stats(stats.get(), output_channels());
+			return;
+		}
+
+		out.hash = nullptr;
+		out.streaming = false;
+
+		if (target.format == pixel_format::indexed)
+		{
+			read_indexed_pixels(out, target.palette_gray);
+			finish_stats(stats.get(), output_channels());
+			return;
+		}
+
+		out.weights = yuv ? &yuv_weights(target.matrix) : &gray_weights(target.matrix);
+		if (yuv)
+		{
+			const size_t chroma_height = (height + 1) / 2;
+			const size_t chroma_row_size = ((width + 1) / 2) * (target.format == pixel_format::nv12 ? 2 : 1);
+			out.chroma_pitch = target.chroma_pitch ? target.chroma_pitch : chroma_row_size;
+			out.chroma[0] = target.chroma[0] ? target.chroma[0] : out.data + out.pitch * height;
+			out.chroma[1] = target.format == pixel_format::nv12 ? nullptr
+				: target.chroma[1] ? target.chroma[1] : out.chroma[0] + out.chroma_pitch * chroma_height;
+
+			if (out.chroma_pitch < chroma_row_size)
+				throw exception(error_code::invalid_argument, "Chroma pitch is too small.");
+		}
+
+		read_color_pixels(out);
+		finish_stats(stats.get(), output_channels());
 	}
 
-	void reader::read_24bpp(int width, int height, int row_size, bool flipped)
+	void reader::finish_stats(const stats_counter* stats, size_t channels)
 	{
-		_image.reset(width, height, 3, row_size);
+		if (!stats)
+			return;
 
-		_stream.seek(_header.offset);
-		_stream.read(_image.data(), sizeof(uint8_t), row_size * height);
+		palette_table palette;
+		palette.assign(_palette);
+		_stats = stats->finish(_info.bit_count, channels, (uint64_t)_info.width * _info.abs_height(), palette);
+	}
+
+	void reader::read_pixels(const output_rows& out)
+	{
+		decode_geometry g;
+		g.width = _info.width;
+		g.height = _info.abs_height();
+		g.row_size = _info.row_size();
+		g.offset = _header.offset;
+
+		palette_table palette;
+		palette.assign(_palette);
+
+		const sample_rows rows = { out.data, out.pitch, out.channel_stride, out.type, g.width, out.scale, out.bias, out.hash, out.stats, out.streaming, out.scratch_padding };
+		if (_info.flipped())
+			decode_bit_count<true>(*_stream, _info.bit_count, is_palette_black_white(), g, rows, out.interleaved, out.rotate, palette);
+		else
+			decode_bit_count<false>(*_stream, _info.bit_count, is_palette_black_white(), g, rows, out.interleaved, out.rotate, palette);
+	}
 
-		if (!flipped)
+	void reader::read_indexed_pixels(const output_rows& out, bool palette_gray)
+	{
+		const int32_t bit_count = _info.bit_count;
+		if (bit_count != 1 && bit_count != 4 && bit_count != 8)
+			throw exception(error_code::unsupported_format, "Indexed output needs a 1, 4 or 8bpp file.");
+
+		decode_geometry g;
+		g.width = _info.width;
+		g.height = _info.abs_height();
+		g.row_size = _info.row_size();
+		g.offset = _header.offset;
+
+		//gray palettes other than the identity ramp are mapped row by row while the row is in cache
+		uint8_t gray[256];
+		bool mapped = false;
+		if (palette_gray && is_palette_gray())
 		{
-			for (int i = 0; i < height; ++i)
+			for (int i = 0; i < 256; ++i)
 			{
-				uint8_t* a = _image.get_row_begin(i);
-				const uint8_t* const end = _image.get_row_end(i);
-				while (a < end)
-				{
-					uint8_t tmp = a[0];
-					a[0] = a[2];
-					a[2] = tmp;
-					a += 3;
-				}
+				gray[i] = (uint8_t)_palette[i];
+				mapped = mapped || gray[i] != i;
 			}
 		}
-		else
+
+		//8bpp rows are the indices already: read straight into the target when its rows are the file rows
+		if (bit_count == 8 && !mapped && !out.streaming && out.pitch == (size_t)g.row_size && (out.scratch_padding || g.row_size == g.width))
 		{
-			for (int i = 0, j = height - 1; i < (height / 2); ++i, --j)
-			{
-				const uint8_t* const end = _image.get_row_end(i);
-				uint8_t* a = _image.get_row_begin(i);
-				uint8_t* b = _image.get_row_begin(j);
-				while (a < end)
-				{
-					uint32_t ac = *(uint32_t*)a;
-					uint32_t bc = *(uint32_t*)b;
-					b[0] = (uint8_t)(ac >> 16);
-					b[1] = (uint8_t)(ac >> 8);
-					b[2] = (uint8_t)ac;
-					b += 3;
-					a[0] = (uint8_t)(bc >> 16);
-					a[1] = (uint8_t)(bc >> 8);
-					a[2] = (uint8_t)bc;
-					a += 3;
-				}
-			}
+			if (_info.flipped())
+				decode_in_place<1, true>(*_stream, g, out.data, out.pitch, nullptr, out.stats);
+			else
+				decode_in_place<1, false>(*_stream, g, out.data, out.pitch, nullptr, out.stats);
+			return;
+		}
 
-			if (height % 2 == 1)
-			{
-				size_t y = height / 2;
-				uint8_t* a = _image.get_row_begin(y);
-				const uint8_t* const end = _image.get_row_end(y);
-				while (a < end)
-				{
-					uint8_t _r = a[0];
-					a[0] = a[2];
-					a[2] = _r;
-					a += 3;
-				}
-			}
+		_stream->seek(g.offset);
+		std::unique_ptr<uint8_t[]> line_buffer(new uint8_t[g.row_size]);
+		std::unique_ptr<uint8_t[]> scratch(out.streaming ? new uint8_t[g.width] : nullptr);
+
+		for (int i = 0; i < g.height; ++i)
+		{
+			const int y = _info.flipped() ? g.height - 1 - i : i;
+			_stream->read(line_buffer.get(), sizeof(uint8_t), g.row_size);
+			if (out.stats)
+				out.stats->count(bit_count, line_buffer.get(), g.width);
+
+			uint8_t* row = out.streaming ? scratch.get() : out.data + out.pitch * y;
+			if (bit_count == 1)
+				unpack_indices<1>(line_buffer.get(), row, g.width);
+			else if (bit_count == 4)
+				unpack_indices<4>(line_buffer.get(), row, g.width);
+			else
+				memcpy(row, line_buffer.get(), g.width);
+
+			for (int x = 0; mapped && x < g.width; ++x)
+				row[x] = gray[row[x]];
+
+			if (out.streaming)
+				stream_row(out.data + out.pitch * y, row, g.width);
 		}
+		if (out.streaming)
+			stream_fence();
 	}
-	 
-	//32bpp not fully work yet
-	void reader::read_32bpp(int width, int height, int row_size, bool flipped)
+
+	void reader::read_color_pixels(const output_rows& out)
 	{
-		const int channels = 4;
-		_image.reset(width, height, channels);
-		_stream.seek(_header.offset);
+		const int32_t width = _info.width;
+		const int32_t height = _info.abs_height();
+		const int32_t bit_count = _info.bit_count;
+		const bool flipped = _info.flipped();
+		const int row_size = _info.row_size();
+
+		if (bit_count != 1 && bit_count != 4 && bit_count != 8 && bit_count != 24 && bit_count != 32)
+			throw exception(error_code::unsupported_format, std::string("not supported bpp ") + std::to_string(bit_count));
+
+		const color_weights& w = *out.weights;
+		const bool yuv = out.format != pixel_format::gray;
+		const bool indexed = bit_count <= 8;
+
+		//palette input: luma and raw chroma are computed once per palette entry instead of per pixel
+		uint8_t luma_lut[256];
+		int32_t u_lut[256];
+		int32_t v_lut[256];
+		if (indexed)
+		{
+			for (int i = 0; i < 256; ++i)
+			{
+				const int32_t r = (_palette[i] >> 16) & 0xFF;
+				const int32_t g = (_palette[i] >> 8) & 0xFF;
+				const int32_t b = _palette[i] & 0xFF;
+				luma_lut[i] = weighted_luma(w, r, g, b);
+				u_lut[i] = w.u[0] * r + w.u[1] * g + w.u[2] * b;
+				v_lut[i] = w.v[0] * r + w.v[1] * g + w.v[2] * b;
+			}
+		}
+
+		_stream->seek(_header.offset);
 
+		const bool convert = out.type != sample_type::u8;
 		std::unique_ptr<uint8_t[]> line_buffer(new uint8_t[row_size]);
-		//int	row = flipped ? height - 1 : 0;
+		std::unique_ptr<uint8_t[]> index_buffer(indexed && bit_count < 8 ? new uint8_t[width] : nullptr);
+		std::unique_ptr<uint8_t[]> scratch(convert ? new uint8_t[width] : nullptr);
+
+		//chroma is accumulated over the two rows of a pair and written once the pair is complete
+		const int chroma_width = (width + 1) / 2;
+		std::unique_ptr<int32_t[]> u_sum(yuv ? new int32_t[chroma_width] : nullptr);
+		std::unique_ptr<int32_t[]> v_sum(yuv ? new int32_t[chroma_width] : nullptr);
+		int chroma_row = -1;
+		int chroma_rows = 0;
+
+		const size_t chroma_step = out.format == pixel_format::nv12 ? 2 : 1;
+		auto flush_chroma = [&]()
+		{
+			uint8_t* u = out.chroma[0] + out.chroma_pitch * chroma_row;
+			uint8_t* v = out.format == pixel_format::nv12 ? u + 1 : out.chroma[1] + out.chroma_pitch * chroma_row;
+			for (int cx = 0; cx < chroma_width; ++cx)
+			{
+				const int32_t count = chroma_rows * (cx * 2 + 1 < width ? 2 : 1);
+				u[cx * chroma_step] = chroma_value(u_sum[cx], count);
+				v[cx * chroma_step] = chroma_value(v_sum[cx], count);
+			}
+		};
+
+		int	row = flipped ? height - 1 : 0;
 		const int inc = flipped ? -1 : 1;
-		const int end = flipped ? -1 : height - 1;
+		const int end = flipped ? -1 : height;
 
-		_stream.read(_image.data(), sizeof(uint8_t), row_size * height);
-		if (!flipped)
+		for (; row != end; row += inc)
 		{
-			for (int i = 0; i < height; ++i)
+			_stream->read(line_buffer.get(), sizeof(uint8_t), row_size);
+			if (out.stats)
+				out.stats->count(bit_count, line_buffer.get(), width);
+			uint8_t* luma = convert ? scratch.get() : out.data + out.pitch * row;
+
+			if (yuv && row / 2 != chroma_row)
 			{
-				uint8_t* a = _image.get_row_begin(i);
-				const uint8_t* const end = _image.get_row_end(i);
-				while (a < end)
-				{
-					uint8_t tmp = a[0];
-					a[0] = a[2];
-					a[2] = tmp;
-					a += channels;
-				}
+				if (chroma_row >= 0)
+					flush_chroma();
+				memset(u_sum.get(), 0, chroma_width * sizeof(int32_t));
+				memset(v_sum.get(), 0, chroma_width * sizeof(int32_t));
+				chroma_row = row / 2;
+				chroma_rows = 0;
 			}
-		}
-		else
-		{
-			for (int i = 0, j = height - 1; i < (height / 2); ++i, --j)
+
+			if (indexed)
 			{
-				const uint8_t* const end = _image.get_row_end(i);
-				uint8_t* a = _image.get_row_begin(i);
-				uint8_t* b = _image.get_row_begin(j);
-				while (a < end)
+				const uint8_t* indices = line_buffer.get();
+				if (bit_count < 8)
 				{
-					uint32_t ac = *(uint32_t*)a;
-					uint32_t bc = *(uint32_t*)b;
-					b[0] = (uint8_t)(ac >> 16);
-					b[1] = (uint8_t)(ac >> 8);
-					b[2] = (uint8_t)ac;
-					b += channels;
-					a[0] = (uint8_t)(bc >> 16);
-					a[1] = (uint8_t)(bc >> 8);
-					a[2] = (uint8_t)bc;
-					a += channels;
+					if (bit_count == 1)
+						unpack_indices<1>(line_buffer.get(), index_buffer.get(), width);
+					else
+						unpack_indices<4>(line_buffer.get(), index_buffer.get(), width);
+					indices = index_buffer.get();
 				}
-			}
 
-			if (height % 2 == 1)
+				for (int x = 0; x < width; ++x)
+					luma[x] = luma_lut[indices[x]];
+
+				if (yuv)
+				{
+					for (int x = 0; x < width; ++x)
+					{
+						u_sum[x >> 1] += u_lut[indices[x]];
+						v_sum[x >> 1] += v_lut[indices[x]];
+					}
+				}
+			}
+			else
 			{
-				size_t y = height / 2;
-				uint8_t* a = _image.get_row_begin(y);
-				const uint8_t* const end = _image.get_row_end(y);
-				while (a < end)
+				const int step = bit_count / 8;
+				const uint8_t* src = line_buffer.get();
+				if (!yuv)
 				{
-					uint8_t _r = a[0];
-					a[0] = a[2];
-					a[2] = _r;
-					a += 3;
+					for (int x = 0; x < width; ++x, src += step)
+						luma[x] = weighted_luma(w, src[2], src[1], src[0]);
+				}
+				else
+				{
+					for (int x = 0; x < width; ++x, src += step)
+					{
+						const int32_t r = src[2], g = src[1], b = src[0];
+						luma[x] = weighted_luma(w, r, g, b);
+						u_sum[x >> 1] += w.u[0] * r + w.u[1] * g + w.u[2] * b;
+						v_sum[x >> 1] += w.v[0] * r + w.v[1] * g + w.v[2] * b;
+					}
 				}
 			}
+
+			++chroma_rows;
+			if (convert)
+				convert_samples(scratch.get(), width, out.data + out.pitch * row, out.type, out.scale[0], out.bias[0]);
 		}
+
+		if (yuv && chroma_row >= 0)
+			flush_chroma();
 	}
 
-	void reader::read_image()
+	void reader::read_region(size_t x, size_t y, const image_view& dst)
 	{
-		const dib_header& info_header = *_dib_header;
-		const int32_t width = info_header.width();
-		const int32_t height = abs(info_header.height());
-		const int32_t bit_count = info_header.bit_count();
-		const bool flipped = info_header.height() > 0;
-		const int row_size = ((bit_count * width + 31) / 32) * 4; //padding to 4 bytes
-
-		read_palette();
-
-		if (bit_count == 1)
-		{
-			read_1bpp(width, height, row_size, flipped);
-		}
-		else if (bit_count == 4)
+		const size_t width = _info.width;
+		const size_t height = _info.abs_height();
+		const int32_t bit_count = _info.bit_count;
+		const bool flipped = _info.flipped();
+		const size_t row_size = _info.row_size();
+		const size_t channels = output_channels();
+		const row_kernel unpack = select_row_kernel(bit_count, is_palette_black_white());
+
+		throw_if_error(check_format());
+		if (x > width || dst.width() > width - x || y > height || dst.height() > height - y)
+			throw exception(error_code::invalid_argument, "Region is out of image bounds.");
+		if (dst.channels() != channels)
+			throw exception(error_code::invalid_argument, "Region has a wrong number of channels.");
+
+		//only the bytes covering the requested columns are read, sub-byte formats start at the enclosing byte
+		const size_t pixels_per_byte = bit_count < 8 ? 8 / bit_count : 1;
+		const size_t first = x - x % pixels_per_byte;
+		const size_t lead = x - first;
+		const size_t begin_byte = first * bit_count / 8;
+		const size_t end_byte = ((x + dst.width()) * bit_count + 7) / 8;
+		const size_t bytes = end_byte - begin_byte;
+
+		std::unique_ptr<uint8_t[]> line_buffer(new uint8_t[bytes]);
+		std::unique_ptr<uint8_t[]> scratch(lead ? new uint8_t[(dst.width() + lead) * channels] : nullptr);
+
+		palette_table palette;
+		palette.assign(_palette);
+
+		for (size_t i = 0; i < dst.height(); ++i)
 		{
-			read_4bpp(width, height, row_size, flipped);
-		}
-		else if ( bit_count == 8)
-		{
-			read_8bpp(width, height, row_size, flipped);
-		}
-		else if (bit_count == 24)
-		{		
-			read_24bpp(width, height, row_size, flipped);
-		}
-		else if (bit_count == 32)
-		{
-			read_32bpp(width, height, row_size, flipped);
-		}
-		else
-		{
-			throw exception(std::string("not supported bpp ") + std::to_string(bit_count));
+			const size_t file_row = flipped ? height - 1 - (y + i) : y + i;
+			_stream->seek((uint64_t)_header.offset + (uint64_t)file_row * row_size + begin_byte);
+			_stream->read(line_buffer.get(), sizeof(uint8_t), bytes);
+
+			if (lead)
+			{
+				unpack(line_buffer.get(), scratch.get(), (int)(dst.width() + lead), palette);
+				memcpy(dst.get_row_begin(i), scratch.get() + lead * channels, dst.width() * channels);
+			}
+			else
+			{
+				unpack(line_buffer.get(), dst.get_row_begin(i), (int)dst.width(), palette);
+			}
 		}
 	}
 
@@ -8,52 +8,168 @@
 #include "data_types.h"
 #include "stream.h"
 #include "image.h"
+#include "image_view.h"
+#include "decode_target.h"
+#include "decode_limits.h"
+#include "stats.h"
 
 namespace fbmp
 {
 	static_assert(sizeof(main_header) == 14, "wrong size of BmpHeader");
 
+	struct color_weights;
+	struct row_hash;
+	struct stats_counter;
+
 	class reader
 	{
 	public:
+		reader();
 		reader(input_stream& stream);
 		reader(input_stream* stream);
 		~reader();
 
+		//switches to another file, the decoded image buffer is kept for reuse
+		void reset(input_stream& stream);
+
 		void read();
+		void read(const decode_target& target);
+		void read_info();
+
+		//noexcept forms of read and read_info, the throwing ones are wrappers around them
+		//bad magic, short reads, bad headers, limits and unsupported bit counts are reported without unwinding
+		status try_read() noexcept;
+		status try_read(const decode_target& target) noexcept;
+		status try_read_info() noexcept;
+
+		size_t output_channels() const;
+		//valid after read_palette, black and white palettes are gray as well
+		bool is_palette_gray() const;
+
+		//checked by read_dib_header and before the image is allocated
+		void set_limits(const decode_limits& limits) { _limits = limits; }
+		const decode_limits& get_limits() const { return _limits; }
+
+		//XXH64 based hash of the decoded pixels computed while the rows are still in cache, see content_hash
+		//interleaved native output only, the same for every sample type and rotation of an image
+		void set_content_hash(bool enabled) { _hash_enabled = enabled; }
+		uint64_t get_content_hash() const { return _content_hash; }
+
+		//histograms, min, max and sums of the native pixels for any target, palette formats count indices
+		//and map them through the palette once per image instead of once per pixel
+		void set_collect_stats(bool enabled) { _stats_enabled = enabled; }
+		const image_stats& get_stats() const { return _stats; }
+
+		//read() of 1, 4 and 8bpp files gives a 1 channel image of palette indices, see get_palette
+		//palette_gray - gray palettes give their gray values instead
+		void set_indexed_output(bool indexed, bool palette_gray = false)
+		{
+			_indexed_output = indexed;
+			_palette_gray_output = palette_gray;
+		}
+
+		//outputs of at least threshold bytes are decoded in large image mode: the image buffer comes from allocate_large
+		//and 8-bit interleaved rows are written with non-temporal stores, SIZE_MAX switches the mode off
+		void set_large_image_mode(size_t threshold, size_t prefault_threads = 0)
+		{
+			_large_threshold = threshold;
+			_prefault_threads = prefault_threads;
+		}
 
 		const main_header& get_main_header() const { return _header; }
 		main_header& get_main_header() { return _header; }
 
-		const dib_header& get_dib_header() const { return *_dib_header; }
-		dib_header& get_dib_header() { return *_dib_header; }
+		const bmp_info& get_info() const { return _info; }
+		//BGRX entries, valid after read_palette
+		const uint32_t* get_palette() const { return _palette; }
 
 		const image& get_image() const { return _image; }
+		//the image leaves the memory budget together with the reader
+		image take_image() { _reservation.release(); return std::move(_image); }
 
-		input_stream& Stream() { return _stream; }
+		input_stream& Stream()
+		{
+			if (!_stream)
+				throw exception(error_code::invalid_argument, "Reader has no input stream.");
+			return *_stream;
+		}
 
 	public:
 		void read_header();
 		void read_dib_header();
 		void read_palette();
 		void read_image();
+		void read_image(const decode_target& target);
+		//read_image after read_palette, for callers that look at the palette or output_channels first
+		void decode_image(const decode_target& target);
+		void read_region(size_t x, size_t y, const image_view& dst);
+
+		status try_read_header() noexcept;
+		status try_read_dib_header() noexcept;
+		status try_read_palette() noexcept;
+		status try_read_image() noexcept;
+		status try_read_image(const decode_target& target) noexcept;
+		status try_decode_image(const decode_target& target) noexcept;
 	private:
-		bool is_palette_black_white();
-
-		void read_1bpp(int width, int height, int row_size, bool flipped);
-		void read_4bpp(int width, int height, int row_size, bool flipped);
-		void read_8bpp(int width, int height, int row_size, bool flipped);
-		void read_24bpp(int width, int height, int row_size, bool flipped);
-		void read_32bpp(int width, int height, int row_size, bool flipped);
+		//resolved destination: pixel (x, y) channel c lives at data + y * pitch + x * pixel_stride + c * channel_stride
+		struct output_rows
+		{
+			uint8_t* data;
+			size_t pitch;
+			size_t channel_stride;
+			size_t pixel_stride;
+			bool interleaved;
+
+			sample_type type;
+			float scale[4][12];
+			float bias[4][12];
+
+			rotation rotate;
+			row_hash* hash;
+			stats_counter* stats;
+			bool streaming;
+			bool scratch_padding;	//bytes of a row past the pixels are the reader's own, a whole file row may land there
+
+			pixel_format format;
+			const color_weights* weights;
+			uint8_t* chroma[2];
+			size_t chroma_pitch;
+		};
+
+		bool is_palette_black_white() const;
+		status check_limits() const;
+		status check_format() const;
+		void decode_native();
+		void decode_pixels(const decode_target& target);
+		void finish_stats(const stats_counter* stats, size_t channels);
+		void read_pixels(const output_rows& out);
+		void read_color_pixels(const output_rows& out);
+		void read_indexed_pixels(const output_rows& out, bool palette_gray);
 
 	private:
-		input_stream& _stream;
+		input_stream* _stream;
 
 		main_header _header;
-		std::unique_ptr<dib_header> _dib_header;
+		bmp_info _info;
 
 		image _image;
 		uint32_t _palette[256];
+
+		decode_limits _limits;
+		budget_reservation _reservation;	//bytes of _image
+
+		bool _hash_enabled = false;
+		uint64_t _content_hash = 0;
+
+		bool _stats_enabled = false;
+		image_stats _stats;
+
+		bool _indexed_output = false;
+		bool _palette_gray_output = false;
+
+		size_t _large_threshold = 256 * 1024 * 1024;
+		size_t _prefault_threads = 0;
+
 	};
 
 }
@@ -0,0 +1,342 @@
+
+#include <string>
+#include <cstring>
+#include <atomic>
+#include "shared_image.h"
+#include "reader.h"
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+namespace fbmp
+{
+
+	namespace
+	{
+		const char shared_magic[4] = {'F', 'B', 'S', 'I'};
+		const uint32_t shared_version = 1;
+		const size_t shared_data_offset = 4096;
+
+#if defined(_WIN32)
+		const shared_handle no_handle = nullptr;
+
+		shared_handle create_segment(const char* name, uint64_t size)
+		{
+			HANDLE mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, (DWORD)(size >> 32), (DWORD)size, name);
+			if (!mapping)
+				throw exception(error_code::open_failed, "Can not create the shared segment.");
+			if (name && GetLastError() == ERROR_ALREADY_EXISTS)
+			{
+				CloseHandle(mapping);
+				throw exception(error_code::open_failed, std::string("Shared segment ") + name + " already exists.");
+			}
+			return mapping;
+		}
+
+		shared_handle open_segment(const char* name)
+		{
+			HANDLE mapping = OpenFileMappingA(FILE_MAP_READ, FALSE, name);
+			if (!mapping)
+				throw exception(error_code::open_failed, std::string("Can not open shared segment ") + name + ".");
+			return mapping;
+		}
+
+		shared_handle duplicate_handle(shared_handle handle)
+		{
+			HANDLE copy = nullptr;
+			if (!DuplicateHandle(GetCurrentProcess(), handle, GetCurrentProcess(), &copy, 0, FALSE, DUPLICATE_SAME_ACCESS))
+				throw exception(error_code::open_failed, "Can not duplicate the shared segment handle.");
+			return copy;
+		}
+
+		void close_handle(shared_handle handle)
+		{
+			CloseHandle(handle);
+		}
+
+		//views of a mapping span its whole size
+		uint8_t* map_segment(shared_handle handle, bool writable, size_t& size)
+		{
+			void* data = MapViewOfFile(handle, writable ? FILE_MAP_WRITE : FILE_MAP_READ, 0, 0, 0);
+			if (!data)
+				throw exception(error_code::open_failed, "Can not map the shared segment.");
+			MEMORY_BASIC_INFORMATION info;
+			size = VirtualQuery(data, &info, sizeof(info)) ? info.RegionSize : 0;
+			return static_cast<uint8_t*>(data);
+		}
+
+		void unmap_segment(uint8_t* data, size_t)
+		{
+			UnmapViewOfFile(data);
+		}
+#else
+		const shared_handle no_handle = -1;
+
+		//anonymous segments without memfd get a unique name that is removed right away
+		std::string unique_name()
+		{
+			static std::atomic<uint64_t> counter(0);
+			return "/fbmp-" + std::to_string((long long)getpid()) + "-" + std::to_string(counter++);
+		}
+
+		shared_handle create_segment(const char* name, uint64_t size)
+		{
+			int fd = -1;
+#if defined(MFD_CLOEXEC) && defined(MFD_ALLOW_SEALING)
+			if (!name)
+				fd = memfd_create("fbmp", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+			else
+#endif
+			{
+				const std::string path = name ? std::string(name) : unique_name();
+				fd = shm_open(path.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+				if (fd >= 0 && !name)
+					shm_unlink(path.c_str());
+			}
+			if (fd < 0)
+				throw exception(error_code::open_failed, std::string("Can not create shared segment ") + (name ? name : "") + ".");
+
+			if (ftruncate(fd, (off_t)size) != 0)
+			{
+				close(fd);
+				if (name)
+					shm_unlink(name);
+				throw exception(error_code::out_of_memory, "Can not size the shared segment.");
+			}
+
+			//consumers can trust the size they map, a segment that shrank would fault on access; only memfd takes seals
+#if defined(F_ADD_SEALS) && defined(F_SEAL_SHRINK)
+			fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL);
+#endif
+			return fd;
+		}
+
+		shared_handle open_segment(const char* name)
+		{
+			const int fd = shm_open(name, O_RDONLY, 0);
+			if (fd < 0)
+				throw exception(error_code::open_failed, std::string("Can not open shared segment ") + name + ".");
+			return fd;
+		}
+
+		shared_handle duplicate_handle(shared_handle handle)
+		{
+			const int fd = fcntl(handle, F_DUPFD_CLOEXEC, 0);
+			if (fd < 0)
+				throw exception(error_code::open_failed, "Can not duplicate the shared segment handle.");
+			return fd;
+		}
+
+		void close_handle(shared_handle handle)
+		{
+			close(handle);
+		}
+
+		//size 0 maps the whole segment and returns its size
+		uint8_t* map_segment(shared_handle handle, bool writable, size_t& size)
+		{
+			if (!size)
+			{
+				struct stat info;
+				if (fstat(handle, &info) != 0)
+					throw exception(error_code::open_failed, "Can not get the shared segment size.");
+				size = (size_t)info.st_size;
+			}
+			if (size < sizeof(shared_image_header))
+				throw exception(error_code::bad_header, "Shared segment is too small.");
+
+			void* data = mmap(nullptr, size, writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, handle, 0);
+			if (data == MAP_FAILED)
+				throw exception(error_code::open_failed, "Can not map the shared segment.");
+			return static_cast<uint8_t*>(data);
+		}
+
+		void unmap_segment(uint8_t* data, size_t size)
+		{
+			munmap(data, size);
+		}
+#endif
+
+		//a segment from another process is checked before any pixel is touched
+		void check_header(const shared_image_header& header, size_t size)
+		{
+			if (memcmp(header.magic, shared_magic, sizeof(shared_magic)) != 0 || header.version != shared_version)
+				throw exception(error_code::bad_magic, "Shared segment does not hold an image.");
+
+			const uint64_t row_size = header.width * header.channels;
+			if (!header.width || !header.height || !header.channels || header.channels > 4 || header.width > UINT32_MAX
+				|| header.pitch < row_size || header.data_offset < sizeof(shared_image_header) || header.data_offset > size
+				|| header.height > (size - header.data_offset) / header.pitch)
+				throw exception(error_code::bad_header, "Shared segment header does not match its size.");
+		}
+	}
+
+	shared_image::shared_image(shared_image&& other)
+		: _handle(other._handle)
+		, _mapping(other._mapping)
+		, _size(other._size)
+		, _writable(other._writable)
+		, _header(other._header)
+	{
+		other._handle = no_handle;
+		other._mapping = nullptr;
+		other._size = 0;
+		other._header = shared_image_header();
+	}
+
+	shared_image& shared_image::operator=(shared_image&& other)
+	{
+		if (this != &other)
+		{
+			reset();
+			std::swap(_handle, other._handle);
+			std::swap(_mapping, other._mapping);
+			std::swap(_size, other._size);
+			std::swap(_writable, other._writable);
+			std::swap(_header, other._header);
+		}
+		return *this;
+	}
+
+	shared_image::~shared_image()
+	{
+		reset();
+	}
+
+	void shared_image::reset()
+	{
+		if (_mapping)
+			unmap_segment(_mapping, _size);
+		if (_handle != no_handle)
+			close_handle(_handle);
+		_handle = no_handle;
+		_mapping = nullptr;
+		_size = 0;
+		_writable = false;
+		_header = shared_image_header();
+	}
+
+	shared_image shared_image::create(size_t width, size_t height, size_t channels, size_t pitch, const char* name)
+	{
+		if (!width || !height || !channels || channels > 4)
+			throw exception(error_code::invalid_argument, "Invalid shared image size.");
+		pitch = pitch ? pitch : width * channels;
+		if (pitch < width * channels)
+			throw exception(error_code::invalid_argument, "Pitch is too small.");
+		if (height > (SIZE_MAX - shared_data_offset) / pitch)
+			throw exception(error_code::limit_exceeded, "Shared image is too large.");
+
+		shared_image result;
+		result._size = shared_data_offset + pitch * height;
+		result._handle = create_segment(name, result._size);
+		result._writable = true;
+		try
+		{
+			result._mapping = map_segment(result._handle, true, result._size);
+		}
+		catch (...)
+		{
+			if (name)
+				remove(name);
+			throw;
+		}
+
+		shared_image_header header;
+		memcpy(header.magic, shared_magic, sizeof(shared_magic));
+		header.version = shared_version;
+		header.width = width;
+		header.height = height;
+		header.channels = channels;
+		header.pitch = pitch;
+		header.data_offset = shared_data_offset;
+		memcpy(result._mapping, &header, sizeof(header));
+		result._header = header;
+		return result;
+	}
+
+	shared_image shared_image::open(shared_handle handle)
+	{
+		return map(duplicate_handle(handle));
+	}
+
+	shared_image shared_image::open(const char* name)
+	{
+		return map(open_segment(name));
+	}
+
+	shared_image shared_image::map(shared_handle handle)
+	{
+		shared_image result;
+		result._handle = handle;
+		result._mapping = map_segment(handle, false, result._size);
+
+		shared_image_header header;
+		memcpy(&header, result._mapping, sizeof(header));
+		check_header(header, result._size);
+		result._header = header;
+		return result;
+	}
+
+	void shared_image::remove(const char* name)
+	{
+#if !defined(_WIN32)
+		shm_unlink(name);
+#else
+		(void)name;	//named mappings go away with their last handle
+#endif
+	}
+
+	image_view shared_image::writable_view()
+	{
+		if (!_writable)
+			throw exception(error_code::invalid_argument, "Shared image is read-only.");
+		return image_view(_mapping + _header.data_offset, width(), height(), channels(), pitch());
+	}
+
+	const_image_view shared_image::view() const
+	{
+		return const_image_view(_mapping + _header.data_offset, width(), height(), channels(), pitch());
+	}
+
+	decode_target shared_image::target()
+	{
+		const image_view pixels = writable_view();
+		return decode_target::interleaved(pixels.data(), pixels.pitch());
+	}
+
+	shared_image read_shared(input_stream& stream, const char* name, const decode_limits& limits)
+	{
+		reader decoder(stream);
+		decoder.set_limits(limits);
+		input_stream_handle stream_handle(stream);
+
+		decoder.read_header();
+		decoder.read_dib_header();
+		decoder.read_palette();
+
+		const bmp_info& info = decoder.get_info();
+		const size_t channels = decoder.output_channels();
+		const uint64_t bytes = (uint64_t)info.width * channels * info.abs_height();
+		if (bytes > limits.max_bytes)
+			throw exception(error_code::limit_exceeded, std::string("Image of ") + std::to_string(bytes) + " bytes exceeds the memory limit.");
+
+		shared_image result = shared_image::create(info.width, info.abs_height(), channels, 0, name);
+		try
+		{
+			decoder.decode_image(result.target());
+		}
+		catch (...)
+		{
+			if (name)
+				shared_image::remove(name);
+			throw;
+		}
+		return result;
+	}
+
+}
@@ -0,0 +1,94 @@
+
+#pragma once
+#ifndef FBMP_SHARED_IMAGE_H
+#define FBMP_SHARED_IMAGE_H
+
+#include <cstdint>
+#include <cstddef>
+
+#include "stream.h"
+#include "image_view.h"
+#include "decode_target.h"
+#include "decode_limits.h"
+
+namespace fbmp
+{
+
+#if defined(_WIN32)
+	typedef void* shared_handle;	//file mapping HANDLE
+#else
+	typedef int shared_handle;		//memfd or shm_open descriptor
+#endif
+
+	//first bytes of a segment, the pixels start at data_offset
+	struct shared_image_header
+	{
+		char magic[4];			//FBSI
+		uint32_t version;
+		uint64_t width;
+		uint64_t height;
+		uint64_t channels;
+		uint64_t pitch;
+		uint64_t data_offset;	//page aligned
+	};
+
+	//8-bit interleaved pixels in a shared memory segment, handed to another process by handle or by name
+	//the producer creates and decodes into it, consumers open it read-only and use the pixels in place
+	//the header is checked and copied once, so a producer rewriting it later can not move a view out of the mapping;
+	//only memfd segments are sealed against shrinking, a shm_open segment truncated by another process raises SIGBUS on access
+	class shared_image
+	{
+	public:
+		shared_image() = default;
+		shared_image(shared_image&& other);
+		shared_image& operator=(shared_image&& other);
+		~shared_image();
+
+		shared_image(const shared_image&) = delete;
+		shared_image& operator=(const shared_image&) = delete;
+
+		//name - nullptr gives an anonymous segment (memfd on Linux) passed on by handle,
+		//otherwise a shm_open name like "/frame-1" that stays until remove
+		static shared_image create(size_t width, size_t height, size_t channels, size_t pitch = 0, const char* name = nullptr);
+
+		//read-only mappings, the handle is duplicated and stays owned by the caller
+		static shared_image open(shared_handle handle);
+		static shared_image open(const char* name);
+		static void remove(const char* name);
+
+		bool empty() const { return _mapping == nullptr; }
+		size_t width() const { return (size_t)_header.width; }
+		size_t height() const { return (size_t)_header.height; }
+		size_t channels() const { return (size_t)_header.channels; }
+		size_t pitch() const { return (size_t)_header.pitch; }
+
+		const_image_view view() const;
+		//writable pixels and a decode target over them, created segments only
+		image_view writable_view();
+		decode_target target();
+
+		shared_handle handle() const { return _handle; }
+		//bytes of the whole segment, header included
+		size_t size() const { return _size; }
+
+	private:
+		static shared_image map(shared_handle handle);
+		void reset();
+
+#if defined(_WIN32)
+		shared_handle _handle = nullptr;
+#else
+		shared_handle _handle = -1;
+#endif
+		uint8_t* _mapping = nullptr;
+		size_t _size = 0;
+		bool _writable = false;
+		shared_image_header _header = {};	//validated copy, the mapped one may change under us
+	};
+
+	//decodes a whole stream straight into a new segment as 8-bit interleaved native pixels
+	shared_image read_shared(input_stream& stream, const char* name = nullptr, const decode_limits& limits = decode_limits());
+
+}
+
+#endif //FBMP_SHARED_IMAGE_H
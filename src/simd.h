@@ -0,0 +1,26 @@
+
+#pragma once
+#ifndef FBMP_SIMD_H
+#define FBMP_SIMD_H
+
+//instruction sets the kernels may use, define FBMP_NO_SIMD to build the scalar paths only
+#if !defined(FBMP_NO_SIMD)
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define FBMP_SSE2 1
+#include <emmintrin.h>
+#endif
+
+#if defined(__SSSE3__) || defined(__AVX__)
+#define FBMP_SSSE3 1
+#include <tmmintrin.h>
+#endif
+
+#if defined(__F16C__) || defined(__AVX2__)
+#define FBMP_F16C 1
+#include <immintrin.h>
+#endif
+
+#endif //FBMP_NO_SIMD
+
+#endif //FBMP_SIMD_H
@@ -0,0 +1,59 @@
+
+#include <cstring>
+#include "stats.h"
+
+namespace fbmp
+{
+
+	image_stats::image_stats()
+	{
+		memset(this, 0, sizeof(*this));
+	}
+
+	void image_stats::summarize()
+	{
+		for (size_t c = 0; c < 4; ++c)
+		{
+			min[c] = 0;
+			max[c] = 0;
+			sum[c] = 0;
+			if (c >= channels)
+				continue;
+
+			int first = -1;
+			int last = -1;
+			for (int v = 0; v < 256; ++v)
+			{
+				if (!histogram[c][v])
+					continue;
+				if (first < 0)
+					first = v;
+				last = v;
+				sum[c] += histogram[c][v] * (uint64_t)v;
+			}
+			min[c] = (uint8_t)(first < 0 ? 0 : first);
+			max[c] = (uint8_t)(last < 0 ? 0 : last);
+		}
+	}
+
+	image_stats compute_stats(const const_image_view& img)
+	{
+		image_stats stats;
+		stats.channels = img.channels();
+		stats.pixels = (uint64_t)img.width() * img.height();
+
+		for (size_t y = 0; y < img.height(); ++y)
+		{
+			const uint8_t* row = img.get_row_begin(y);
+			for (size_t x = 0; x < img.width(); ++x)
+			{
+				for (size_t c = 0; c < stats.channels; ++c)
+					++stats.histogram[c][row[x * stats.channels + c]];
+			}
+		}
+
+		stats.summarize();
+		return stats;
+	}
+
+}
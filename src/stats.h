@@ -0,0 +1,37 @@
+
+#pragma once
+#ifndef FBMP_STATS_H
+#define FBMP_STATS_H
+
+#include <cstdint>
+#include <cstddef>
+
+#include "image_view.h"
+
+namespace fbmp
+{
+
+	//per channel statistics of 8-bit pixels, channels are ordered like the reader's image: R, G, B, A or gray
+	struct image_stats
+	{
+		size_t channels;
+		uint64_t pixels;
+		uint64_t histogram[4][256];
+		uint8_t min[4];
+		uint8_t max[4];
+		uint64_t sum[4];
+
+		image_stats();
+
+		double mean(size_t channel) const { return pixels ? (double)sum[channel] / (double)pixels : 0.0; }
+
+		//fills min, max and sum from the histograms
+		void summarize();
+	};
+
+	//the statistics the reader collects while it decodes, for images from any other source
+	image_stats compute_stats(const const_image_view& img);
+
+}
+
+#endif //FBMP_STATS_H
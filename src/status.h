@@ -0,0 +1,51 @@
+
+#pragma once
+#ifndef FBMP_STATUS_H
+#define FBMP_STATUS_H
+
+#include <string>
+#include <utility>
+
+namespace fbmp
+{
+
+	enum class error_code
+	{
+		none,
+		open_failed,		//the stream could not be opened
+		read_failed,		//short read or failed seek, usually a truncated file
+		write_failed,
+		bad_magic,			//the file does not start with BM
+		bad_header,			//dib header of an unknown size or with an invalid image size
+		unsupported_format,	//bit count the decoders do not handle
+		limit_exceeded,		//decode_limits or the memory budget
+		invalid_argument,	//target, region or stream that does not fit the call
+		out_of_memory,
+		unknown
+	};
+
+	//outcome of the noexcept API: ok, or the kind of failure with a message
+	class status
+	{
+	public:
+		status() = default;
+
+		status(error_code code, std::string message)
+			: _code(code)
+			, _message(std::move(message))
+		{}
+
+		bool ok() const { return _code == error_code::none; }
+		explicit operator bool() const { return ok(); }
+
+		error_code code() const { return _code; }
+		const std::string& message() const { return _message; }
+
+	private:
+		error_code _code = error_code::none;
+		std::string _message;
+	};
+
+}
+
+#endif //FBMP_STATUS_H
@@ -3,6 +3,13 @@
 #ifndef FBMP_STREAM_H
 #define FBMP_STREAM_H
 
+#include <new>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+
+#include "status.h"
+
 namespace fbmp
 {
 
@@ -13,7 +20,36 @@ namespace fbmp
 		virtual void open_for_reading() = 0;
 		virtual void close() = 0;
 		virtual void read(void* buffer, size_t element_size, size_t count) = 0;
-		virtual void seek(int position) = 0;
+		virtual void seek(uint64_t position) = 0;
+		//total bytes of the stream, 0 - unknown
+		virtual uint64_t size() { return 0; }
+
+		//non-throwing forms used by the status API, streams override them to fail without unwinding
+		virtual status try_open_for_reading() noexcept
+		{
+			try
+			{
+				open_for_reading();
+				return status();
+			}
+			catch (const std::exception& e)
+			{
+				return status(error_code::open_failed, e.what());
+			}
+		}
+
+		virtual status try_read(void* buffer, size_t element_size, size_t count) noexcept
+		{
+			try
+			{
+				read(buffer, element_size, count);
+				return status();
+			}
+			catch (const std::exception& e)
+			{
+				return status(error_code::read_failed, e.what());
+			}
+		}
 	};
 
 	class output_stream
@@ -25,6 +61,68 @@ namespace fbmp
 		virtual void write(const void* buffer, size_t element_size, size_t count) = 0;
 	};
 
+	//output that can be written at any offset, write_at may be called from several threads at once
+	class positional_output_stream : public output_stream
+	{
+	public:
+		//sets the final size up front so positional writes never extend the file
+		virtual void reserve(uint64_t size) = 0;
+		virtual void write_at(uint64_t offset, const void* buffer, size_t size) = 0;
+	};
+
+	//keeps a stream open for the lifetime of a read or write call
+	class input_stream_handle
+	{
+	public:
+		input_stream_handle(input_stream& stream)
+			: m_stream(stream)
+		{
+			m_stream.open_for_reading();
+		}
+
+		//opens without throwing, the stream is closed only if get_status is ok
+		input_stream_handle(input_stream& stream, std::nothrow_t) noexcept
+			: m_stream(stream)
+			, m_status(stream.try_open_for_reading())
+		{}
+
+		input_stream_handle(const input_stream_handle&) = delete;
+		input_stream_handle& operator=(const input_stream_handle&) = delete;
+
+		~input_stream_handle()
+		{
+			if (m_status.ok())
+				m_stream.close();
+		}
+
+		const status& get_status() const { return m_status; }
+
+	private:
+		input_stream& m_stream;
+		status m_status;
+	};
+
+	class output_stream_handle
+	{
+	public:
+		output_stream_handle(output_stream& stream)
+			: m_stream(stream)
+		{
+			m_stream.open_for_writing();
+		}
+
+		output_stream_handle(const output_stream_handle&) = delete;
+		output_stream_handle& operator=(const output_stream_handle&) = delete;
+
+		~output_stream_handle()
+		{
+			m_stream.close();
+		}
+
+	private:
+		output_stream& m_stream;
+	};
+
 }
 
 #endif //FBMP_FILE_STREAM_H
@@ -0,0 +1,181 @@
+
+#include <cstring>
+#include <cstdlib>
+#include <algorithm>
+#include "tile_cache.h"
+
+namespace fbmp
+{
+
+	namespace
+	{
+		const size_t max_prefetch_queue = 256;
+	}
+
+	tile_cache::tile_cache(input_stream& stream, const tile_cache_options& options)
+		: _stream(stream)
+		, _reader(stream)
+		, _options(options)
+		, _cache(options.memory_budget)
+	{
+		if (_options.tile_size == 0)
+			throw exception(error_code::invalid_argument, "Tile size can not be zero.");
+
+		_reader.set_limits(_options.limits);
+		_stream.open_for_reading();
+		try
+		{
+			_reader.read_header();
+			_reader.read_dib_header();
+			_reader.read_palette();
+		}
+		catch (...)
+		{
+			_stream.close();
+			throw;
+		}
+
+		_width = _reader.get_info().width;
+		_height = _reader.get_info().abs_height();
+		_channels = _reader.output_channels();
+		_tiles_x = (_width + _options.tile_size - 1) / _options.tile_size;
+		_tiles_y = (_height + _options.tile_size - 1) / _options.tile_size;
+
+		for (size_t i = 0; i < _options.prefetch_threads; ++i)
+			_workers.emplace_back(&tile_cache::prefetch_worker, this);
+	}
+
+	tile_cache::~tile_cache()
+	{
+		{
+			std::lock_guard<std::mutex> lock(_queue_mutex);
+			_stop = true;
+		}
+		_queue_condition.notify_all();
+		for (std::thread& worker : _workers)
+			worker.join();
+
+		_stream.close();
+	}
+
+	tile_cache::tile_ptr tile_cache::get_tile(size_t tx, size_t ty)
+	{
+		if (tx >= _tiles_x || ty >= _tiles_y)
+			throw exception(error_code::invalid_argument, "Tile is out of image bounds.");
+
+		tile_ptr tile = _cache.get_or_load(tile_key(tx, ty), [&]() { return load_tile(tx, ty); });
+
+		if (_options.prefetch_radius)
+			prefetch(tx, ty, _options.prefetch_radius);
+
+		return tile;
+	}
+
+	void tile_cache::prefetch(size_t tx, size_t ty, size_t radius)
+	{
+		const size_t x_begin = tx > radius ? tx - radius : 0;
+		const size_t y_begin = ty > radius ? ty - radius : 0;
+		const size_t x_end = std::min(tx + radius + 1, _tiles_x);
+		const size_t y_end = std::min(ty + radius + 1, _tiles_y);
+
+		std::vector<uint64_t> keys;
+		for (size_t y = y_begin; y < y_end; ++y)
+		{
+			for (size_t x = x_begin; x < x_end; ++x)
+			{
+				const uint64_t key = tile_key(x, y);
+				if (!_cache.contains(key))
+					keys.push_back(key);
+			}
+		}
+
+		if (keys.empty())
+			return;
+
+		if (_workers.empty())
+		{
+			for (uint64_t key : keys)
+				_cache.get_or_load(key, [&]() { return load_tile((size_t)(key & 0xFFFFFFFF), (size_t)(key >> 32)); });
+			return;
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(_queue_mutex);
+			for (uint64_t key : keys)
+				_queue.push_back(key);
+			//the most recent requests matter most while panning, stale ones are dropped
+			while (_queue.size() > max_prefetch_queue)
+				_queue.pop_front();
+		}
+		_queue_condition.notify_all();
+	}
+
+	void tile_cache::read_region(size_t x, size_t y, const image_view& dst)
+	{
+		if (x > _width || dst.width() > _width - x || y > _height || dst.height() > _height - y)
+			throw exception(error_code::invalid_argument, "Region is out of image bounds.");
+		if (dst.channels() != _channels)
+			throw exception(error_code::invalid_argument, "Region has a wrong number of channels.");
+		if (dst.empty())
+			return;
+
+		const size_t size = _options.tile_size;
+		for (size_t ty = y / size; ty * size < y + dst.height(); ++ty)
+		{
+			for (size_t tx = x / size; tx * size < x + dst.width(); ++tx)
+			{
+				const tile_ptr tile = get_tile(tx, ty);
+				const size_t left = std::max(x, tx * size);
+				const size_t top = std::max(y, ty * size);
+				const size_t right = std::min(x + dst.width(), tx * size + tile->width());
+				const size_t bottom = std::min(y + dst.height(), ty * size + tile->height());
+
+				for (size_t row = top; row < bottom; ++row)
+				{
+					const uint8_t* src = tile->get_row_begin(row - ty * size) + (left - tx * size) * _channels;
+					memcpy(dst.get_pixel(left - x, row - y), src, (right - left) * _channels);
+				}
+			}
+		}
+	}
+
+	tile_cache::tile_ptr tile_cache::load_tile(size_t tx, size_t ty)
+	{
+		const size_t size = _options.tile_size;
+		const size_t x = tx * size;
+		const size_t y = ty * size;
+		std::shared_ptr<image> tile = std::make_shared<image>(std::min(size, _width - x), std::min(size, _height - y), _channels);
+
+		std::lock_guard<std::mutex> lock(_io_mutex);
+		_reader.read_region(x, y, *tile);
+		return tile;
+	}
+
+	void tile_cache::prefetch_worker()
+	{
+		for (;;)
+		{
+			uint64_t key;
+			{
+				std::unique_lock<std::mutex> lock(_queue_mutex);
+				_queue_condition.wait(lock, [this]() { return _stop || !_queue.empty(); });
+				if (_stop)
+					return;
+				key = _queue.back();
+				_queue.pop_back();
+			}
+
+			const size_t tx = (size_t)(key & 0xFFFFFFFF);
+			const size_t ty = (size_t)(key >> 32);
+			try
+			{
+				_cache.get_or_load(key, [&]() { return load_tile(tx, ty); });
+			}
+			catch (...)
+			{
+				//prefetching is best effort, the failure is reported to whoever requests the tile
+			}
+		}
+	}
+
+}
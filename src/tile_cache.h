@@ -0,0 +1,88 @@
+
+#pragma once
+#ifndef FBMP_TILE_CACHE_H
+#define FBMP_TILE_CACHE_H
+
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <condition_variable>
+
+#include "stream.h"
+#include "reader.h"
+#include "image_view.h"
+#include "lru_cache.h"
+
+namespace fbmp
+{
+
+	struct tile_cache_options
+	{
+		size_t tile_size = 256;
+		size_t memory_budget = 256 * 1024 * 1024;	//bytes of decoded tiles kept by the cache
+		size_t prefetch_radius = 0;					//neighbours queued around every requested tile, 0 - only on prefetch()
+		size_t prefetch_threads = 1;				//background decoders, 0 - prefetch() decodes on the calling thread
+		decode_limits limits;						//header checks, max_bytes does not apply as only tiles are allocated
+	};
+
+	//random access over a large uncompressed bmp: fixed size tiles are decoded on demand
+	//straight from the covering file bytes and kept in a memory bounded LRU cache
+	//the stream stays open for the lifetime of the cache
+	class tile_cache
+	{
+	public:
+		typedef std::shared_ptr<const image> tile_ptr;
+
+		tile_cache(input_stream& stream, const tile_cache_options& options = tile_cache_options());
+		~tile_cache();
+
+		tile_cache(const tile_cache&) = delete;
+		tile_cache& operator=(const tile_cache&) = delete;
+
+		size_t width() const { return _width; }
+		size_t height() const { return _height; }
+		size_t channels() const { return _channels; }
+		size_t tile_size() const { return _options.tile_size; }
+		size_t tiles_x() const { return _tiles_x; }
+		size_t tiles_y() const { return _tiles_y; }
+
+		tile_ptr get_tile(size_t tx, size_t ty);
+		void prefetch(size_t tx, size_t ty, size_t radius = 1);
+		void read_region(size_t x, size_t y, const image_view& dst);
+
+		size_t memory_used() const { return _cache.memory_used(); }
+		size_t hits() const { return _cache.hits(); }
+		size_t misses() const { return _cache.misses(); }
+
+	private:
+		tile_ptr load_tile(size_t tx, size_t ty);
+		void prefetch_worker();
+
+		static uint64_t tile_key(size_t tx, size_t ty) { return ((uint64_t)ty << 32) | (uint64_t)tx; }
+
+	private:
+		input_stream& _stream;
+		reader _reader;
+		std::mutex _io_mutex;
+
+		const tile_cache_options _options;
+		size_t _width = 0;
+		size_t _height = 0;
+		size_t _channels = 0;
+		size_t _tiles_x = 0;
+		size_t _tiles_y = 0;
+
+		lru_cache<uint64_t, image> _cache;
+
+		std::mutex _queue_mutex;
+		std::condition_variable _queue_condition;
+		std::deque<uint64_t> _queue;
+		bool _stop = false;
+		std::vector<std::thread> _workers;
+	};
+
+}
+
+#endif //FBMP_TILE_CACHE_H
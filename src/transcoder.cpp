@@ -0,0 +1,258 @@
+
+#include <vector>
+#include <algorithm>
+#include <cstring>
+#include "transcoder.h"
+#include "reader.h"
+#include "convert.h"
+#include "decode_kernels.h"
+
+namespace fbmp
+{
+
+	namespace
+	{
+		struct row_tables
+		{
+			const uint32_t* palette;	//BGRX
+			const color_weights* weights;
+			uint8_t luma[256];			//luma of every palette entry
+		};
+
+		//converts the pixels of one file row, the padding of dst is left untouched
+		typedef void (*transcode_row_fn)(const uint8_t* src, uint8_t* dst, int width, const row_tables& tables);
+
+#if defined(FBMP_SSSE3)
+		inline __m128i bgr_to_bgrx_mask()
+		{
+			return _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+		}
+#endif
+
+		void bgra32_to_bgr24(const uint8_t* src, uint8_t* dst, int width, const row_tables&)
+		{
+			int x = 0;
+#if defined(FBMP_SSSE3)
+			const __m128i mask = _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+			for (; x + 4 <= width; x += 4)
+			{
+				const __m128i value = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + x * 4)), mask);
+				_mm_storel_epi64(reinterpret_cast<__m128i*>(dst + x * 3), value);
+				const uint32_t last = (uint32_t)_mm_cvtsi128_si32(_mm_srli_si128(value, 8));
+				memcpy(dst + x * 3 + 8, &last, 4);
+			}
+#endif
+			for (; x < width; ++x)
+				memcpy(dst + x * 3, src + x * 4, 3);
+		}
+
+		void bgr24_to_bgra32(const uint8_t* src, uint8_t* dst, int width, const row_tables&)
+		{
+			int x = 0;
+#if defined(FBMP_SSSE3)
+			const __m128i mask = bgr_to_bgrx_mask();
+			const __m128i alpha = _mm_set1_epi32((int)0xFF000000);
+			for (; x + 6 <= width; x += 4)
+			{
+				const __m128i value = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + x * 3)), mask);
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + x * 4), _mm_or_si128(value, alpha));
+			}
+#endif
+			for (; x < width; ++x)
+			{
+				memcpy(dst + x * 4, src + x * 3, 3);
+				dst[x * 4 + 3] = 255;
+			}
+		}
+
+		void bgra32_to_gray8(const uint8_t* src, uint8_t* dst, int width, const row_tables& tables)
+		{
+			luma_row(src, width, 4, true, *tables.weights, dst);
+		}
+
+		void bgr24_to_gray8(const uint8_t* src, uint8_t* dst, int width, const row_tables& tables)
+		{
+			luma_row(src, width, 3, true, *tables.weights, dst);
+		}
+
+		template <int BitCount>
+		void indexed_to_bgr24(const uint8_t* src, uint8_t* dst, int width, const row_tables& tables)
+		{
+			for (int x = 0; x < width; ++x)
+				memcpy(dst + x * 3, &tables.palette[pixel_index<BitCount>(src, x)], 3);
+		}
+
+		template <int BitCount>
+		void indexed_to_bgra32(const uint8_t* src, uint8_t* dst, int width, const row_tables& tables)
+		{
+			for (int x = 0; x < width; ++x)
+			{
+				const uint32_t color = tables.palette[pixel_index<BitCount>(src, x)] | 0xFF000000;
+				memcpy(dst + x * 4, &color, 4);
+			}
+		}
+
+		template <int BitCount>
+		void indexed_to_gray8(const uint8_t* src, uint8_t* dst, int width, const row_tables& tables)
+		{
+			for (int x = 0; x < width; ++x)
+				dst[x] = tables.luma[pixel_index<BitCount>(src, x)];
+		}
+
+		template <int BitCount>
+		transcode_row_fn select_indexed(transcode_format format)
+		{
+			switch (format)
+			{
+			case transcode_format::bgr24:
+				return indexed_to_bgr24<BitCount>;
+			case transcode_format::bgra32:
+				return indexed_to_bgra32<BitCount>;
+			case transcode_format::gray8:
+				return indexed_to_gray8<BitCount>;
+			default:
+				return nullptr;
+			}
+		}
+
+		//nullptr - rows are copied as they are
+		transcode_row_fn select_transcode(int32_t bit_count, transcode_format format)
+		{
+			switch (bit_count)
+			{
+			case 1:
+				return select_indexed<1>(format);
+			case 4:
+				return select_indexed<4>(format);
+			case 8:
+				return select_indexed<8>(format);
+			case 24:
+				return format == transcode_format::bgra32 ? bgr24_to_bgra32
+					: format == transcode_format::gray8 ? bgr24_to_gray8 : nullptr;
+			default:
+				return format == transcode_format::bgr24 ? bgra32_to_bgr24
+					: format == transcode_format::gray8 ? bgra32_to_gray8 : nullptr;
+			}
+		}
+
+		int32_t transcoded_bit_count(int32_t bit_count, transcode_format format)
+		{
+			switch (format)
+			{
+			case transcode_format::bgr24:
+				return 24;
+			case transcode_format::bgra32:
+				return 32;
+			case transcode_format::gray8:
+				return 8;
+			default:
+				return bit_count;
+			}
+		}
+	}
+
+	void transcoder::transcode(input_stream& input, output_stream& output, const transcode_options& options)
+	{
+		input_stream_handle input_handle(input);
+
+		reader source(input);
+		source.set_limits(options.limits);
+		source.read_header();
+		source.read_dib_header();
+		source.read_palette();
+
+		const bmp_info& info = source.get_info();
+		const int32_t bit_count = info.bit_count;
+		throw_if_error(check_pixel_format(info));
+
+		const int32_t width = info.width;
+		const int32_t height = info.abs_height();
+		const int32_t target_bit_count = transcoded_bit_count(bit_count, options.format);
+		const int32_t palette_colors = target_bit_count <= 8 ? (1 << target_bit_count) : 0;
+		const bool flipped = options.order == row_order::keep ? info.flipped() : options.order == row_order::bottom_up;
+		const bool reverse = flipped != info.flipped();
+
+		const size_t src_row_size = info.row_size();
+		const size_t dst_row_size = (size_t)((((uint64_t)target_bit_count * width + 31) / 32) * 4); //padding to 4 bytes
+		if (dst_row_size > (size_t)INT32_MAX)
+			throw exception(error_code::limit_exceeded, "Transcoded rows are too long.");
+		const transcode_row_fn convert = select_transcode(bit_count, options.format);
+
+		row_tables tables;
+		tables.palette = source.get_palette();
+		tables.weights = &gray_weights(options.matrix);
+		for (int i = 0; i < 256; ++i)
+			tables.luma[i] = weighted_luma(*tables.weights, (tables.palette[i] >> 16) & 0xFF, (tables.palette[i] >> 8) & 0xFF, tables.palette[i] & 0xFF);
+
+		dib_bitmap_info_header dib;
+		dib.header.width = width;
+		dib.header.height = flipped ? height : -height;
+		dib.header.planes = 1;
+		dib.header.bit_count = (int16_t)target_bit_count;
+		//sizes that do not fit the 32-bit fields are written as 0, readers derive them from the dimensions
+		const uint64_t image_size = (uint64_t)dst_row_size * height;
+		dib.header.image_size = image_size <= (uint64_t)INT32_MAX ? (int32_t)image_size : 0;
+		dib.header.x_peels_per_meter = info.x_peels_per_meter;
+		dib.header.y_peels_per_meter = info.y_peels_per_meter;
+		dib.header.palette_colors = palette_colors;
+
+		main_header header = source.get_main_header();
+		header.reserved1 = 0;
+		header.reserved2 = 0;
+		header.offset = sizeof(main_header) + dib.size() + palette_colors * sizeof(uint32_t);
+		const uint64_t file_size = header.offset + image_size;
+		header.file_size = file_size <= UINT32_MAX ? (uint32_t)file_size : 0;
+
+		output_stream_handle output_handle(output);
+		const int32_t header_size = dib.size();
+		output.write(&header, sizeof(main_header), 1);
+		output.write(&header_size, sizeof(int32_t), 1);
+		output.write(dib.data(), (size_t)header_size - sizeof(int32_t), 1);
+
+		if (palette_colors)
+		{
+			uint32_t palette[256];
+			for (int i = 0; i < palette_colors; ++i)
+				palette[i] = options.format == transcode_format::gray8 ? (uint32_t)(i | (i << 8) | (i << 16)) : tables.palette[i];
+			output.write(palette, sizeof(uint32_t), palette_colors);
+		}
+
+		//rows move in chunks, a reversed order reads the chunks from the end of the pixel data
+		const size_t chunk_rows = std::min<size_t>(std::max<size_t>(1, options.chunk_size / std::max(src_row_size, dst_row_size)), height);
+		std::vector<uint8_t> chunk(src_row_size * chunk_rows);
+		std::vector<uint8_t> converted(convert ? dst_row_size * chunk_rows : 0, 0);
+
+		const uint64_t offset = source.get_main_header().offset;
+		input.seek(offset);
+
+		for (int32_t done = 0; done < height;)
+		{
+			const int32_t count = std::min<int32_t>((int32_t)chunk_rows, height - done);
+			if (reverse)
+				input.seek(offset + (uint64_t)src_row_size * (height - done - count));
+			input.read(chunk.data(), sizeof(uint8_t), src_row_size * count);
+			done += count;
+
+			if (!convert)
+			{
+				if (!reverse)
+				{
+					output.write(chunk.data(), sizeof(uint8_t), src_row_size * count);
+					continue;
+				}
+
+				for (int32_t k = count - 1; k >= 0; --k)
+					output.write(chunk.data() + src_row_size * k, sizeof(uint8_t), src_row_size);
+				continue;
+			}
+
+			for (int32_t k = 0; k < count; ++k)
+			{
+				const uint8_t* src = chunk.data() + src_row_size * (reverse ? count - 1 - k : k);
+				convert(src, converted.data() + dst_row_size * k, width, tables);
+			}
+			output.write(converted.data(), sizeof(uint8_t), dst_row_size * count);
+		}
+	}
+
+}
@@ -0,0 +1,43 @@
+
+#pragma once
+#ifndef FBMP_TRANSCODER_H
+#define FBMP_TRANSCODER_H
+
+#include <cstdint>
+
+#include "stream.h"
+#include "data_types.h"
+#include "decode_target.h"
+#include "decode_limits.h"
+
+namespace fbmp
+{
+
+	enum class transcode_format
+	{
+		keep,		//same bit count and palette
+		bgr24,
+		bgra32,		//alpha is kept from 32bpp sources, 255 otherwise
+		gray8		//8bpp with a gray ramp palette
+	};
+
+	struct transcode_options
+	{
+		transcode_format format = transcode_format::keep;
+		row_order order = row_order::keep;
+		color_matrix matrix = color_matrix::bt601;	//luma weights of gray8
+		size_t chunk_size = 256 * 1024;				//bytes of file rows read with one call
+		decode_limits limits;						//header checks of the source, max_bytes does not apply as rows are streamed
+	};
+
+	//bmp to bmp conversion streamed in chunks of rows, the image is never decoded as a whole
+	//rewritten files always get a 40 byte info header
+	class transcoder
+	{
+	public:
+		void transcode(input_stream& input, output_stream& output, const transcode_options& options = transcode_options());
+	};
+
+}
+
+#endif //FBMP_TRANSCODER_H
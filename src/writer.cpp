@@ -1,32 +1,17 @@
 
 #include <vector>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
 #include "writer.h"
 #include "image.h"
+#include "convert.h"
+#include "decode_kernels.h"
+#include "parallel.h"
 
 namespace fbmp
 {
 
-	class output_stream_handle
-	{
-	public:
-		output_stream_handle(output_stream& stream)
-			: m_stream(stream)
-		{
-			m_stream.open_for_writing();
-		}
-
-		output_stream_handle(const output_stream_handle&) = delete;
-		output_stream_handle& operator=(const output_stream_handle&) = delete;
-
-		~output_stream_handle()
-		{
-			m_stream.close();
-		}
-
-	private:
-		output_stream& m_stream;
-	};
-
 	struct PixelFormat
 	{
 		uint16_t r;
@@ -35,72 +20,254 @@ namespace fbmp
 		uint16_t a;
 	};
 
-	void writer::write(output_stream& stream, main_header& _main_header, const dib_header& info_header, const image& _image)
+	namespace
 	{
-		output_stream_handle handle(stream);
+		//where everything goes in the output file
+		struct file_layout
+		{
+			int width;
+			int height;
+			bool flipped;
+			int bit_count;
+			size_t row_size;
+			int32_t header_size;
+			size_t palette_size;
+			uint32_t offset;
+			uint64_t file_size;
+		};
+
+		file_layout layout_of(const dib_header& info_header)
+		{
+			file_layout layout;
+			layout.width = info_header.width();
+			layout.height = abs(info_header.height());
+			layout.flipped = info_header.height() > 0;
+			layout.bit_count = info_header.bit_count();
+			layout.row_size = (size_t)((((uint64_t)layout.bit_count * (uint32_t)layout.width + 31) / 32) * 4);
+			layout.header_size = info_header.size();
+			layout.palette_size = layout.bit_count == 1 ? sizeof(PixelFormat) : 0;
+
+			if (layout.bit_count != 1 && layout.bit_count != 24 && layout.bit_count != 32)
+				throw exception(error_code::unsupported_format, std::string("not supported bpp ") + std::to_string(layout.bit_count));
 
-		//info_header.height = -abs(info_header.height());
-		int width = info_header.width();
-		int height = -info_header.height();
-		const int rowSize = ((width + 31) / 32) * 4;
-		const int pixelFormatSize = info_header.bit_count() == 1 ? 8 : 0;
-		_main_header.offset = sizeof(main_header)+sizeof(dib_header)+sizeof(int32_t)+pixelFormatSize; //+ rozmiar
-		const int imageSize = rowSize * height + _main_header.offset;
-		_main_header.file_size = imageSize;
+			layout.offset = (uint32_t)(sizeof(main_header) + layout.header_size + layout.palette_size);
+			layout.file_size = (uint64_t)layout.row_size * layout.height + layout.offset;
+			return layout;
+		}
 
-		int32_t headerSize = sizeof(dib_header)+sizeof(uint32_t);
+		file_layout compute_layout(main_header& main_header, const dib_header& info_header, const const_image_view& image)
+		{
+			const file_layout layout = layout_of(info_header);
+			if (image.width() < (size_t)layout.width || image.height() < (size_t)layout.height)
+				throw exception(error_code::invalid_argument, "Image is smaller than the dib header dimensions.");
+			if (image.channels() * 8 < (size_t)layout.bit_count || (layout.bit_count == 32 && image.channels() != 4))
+				throw exception(error_code::invalid_argument, "Image has too few channels for the bit count.");
 
-		stream.write(&_main_header, sizeof(main_header), 1);
-		stream.write(&headerSize, sizeof(int32_t), 1);
-		stream.write(info_header.data(), (size_t)info_header.size(), 1);
+			main_header.offset = layout.offset;
+			//files over 4 GB get 0, the size is derived from the dimensions when they are read
+			main_header.file_size = layout.file_size <= UINT32_MAX ? (uint32_t)layout.file_size : 0;
+			return layout;
+		}
+
+		size_t luma_size(const file_layout& layout, const const_image_view& image)
+		{
+			return layout.bit_count == 1 && image.channels() > 1 ? layout.width : 0;
+		}
 
-		if (info_header.bit_count() == 1)
+		//main header, dib header and palette as they are stored in the file
+		std::vector<uint8_t> encode_headers(const main_header& main_header, const dib_header& info_header, const file_layout& layout)
 		{
-			PixelFormat f;
-			f.r = 0;
-			f.g = 0;
-			f.b = 0xffff;
-			f.a = 0xffff;
-			stream.write(&f, sizeof(PixelFormat), 1);
-
-			std::vector<uint8_t> dataToWrite;
-			for (int y = height - 1; y >= 0; --y)
+			std::vector<uint8_t> headers(layout.offset);
+			uint8_t* out = headers.data();
+
+			memcpy(out, &main_header, sizeof(main_header));
+			out += sizeof(main_header);
+			memcpy(out, &layout.header_size, sizeof(int32_t));
+			out += sizeof(int32_t);
+			memcpy(out, info_header.data(), (size_t)layout.header_size - sizeof(int32_t));
+			out += layout.header_size - sizeof(int32_t);
+
+			if (layout.bit_count == 1)
 			{
-				const uint8_t* row = _image.get_row_begin(y);
-				const uint8_t* const rowEnd = row + width;
-				dataToWrite.resize(0);
+				PixelFormat f;
+				f.r = 0;
+				f.g = 0;
+				f.b = 0xffff;
+				f.a = 0x00ff;	//the reserved byte of white stays 0
+				memcpy(out, &f, sizeof(PixelFormat));
+			}
+			return headers;
+		}
 
-				while (row < rowEnd)
+		struct bit_reverse_table
+		{
+			uint8_t values[256];
+
+			constexpr bit_reverse_table()
+				: values()
+			{
+				for (int value = 0; value < 256; ++value)
 				{
-					uint8_t value = 0;
-					for (int i = 7; i >= 0 && row < rowEnd; --i)
+					for (int k = 0; k < 8; ++k)
 					{
-						value |= (*row >> 7) << i;
-						++row;
+						if ((value >> k) & 1)
+							values[value] |= (uint8_t)(0x80 >> k);
 					}
-					dataToWrite.push_back(value);
 				}
-				dataToWrite.resize(rowSize, 0);
-				stream.write(&dataToWrite[0], sizeof(uint8_t), dataToWrite.size());
+			}
+		};
+
+		constexpr bit_reverse_table bit_reverse;
+
+		//pixels at or above threshold become 1 bits, the first pixel of a byte is its top bit
+		void pack_threshold_row(const uint8_t* src, size_t width, uint8_t threshold, uint8_t* out)
+		{
+			size_t x = 0;
+
+#if defined(FBMP_SSE2)
+			//movemask puts pixel 0 into bit 0, the table turns every byte around
+			const __m128i limit = _mm_set1_epi8((char)threshold);
+			auto pack16 = [&](const uint8_t* pixels, uint8_t* bytes)
+			{
+				const __m128i value = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pixels));
+				const uint32_t mask = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_max_epu8(value, limit), value));
+				bytes[0] = bit_reverse.values[mask & 0xFF];
+				bytes[1] = bit_reverse.values[mask >> 8];
+			};
+
+			//64 pixels -> 8 output bytes per iteration
+			for (; x + 64 <= width; x += 64, out += 8)
+			{
+				pack16(src + x, out);
+				pack16(src + x + 16, out + 2);
+				pack16(src + x + 32, out + 4);
+				pack16(src + x + 48, out + 6);
+			}
+			for (; x + 16 <= width; x += 16, out += 2)
+				pack16(src + x, out);
+#endif
+
+			for (; x < width; x += 8)
+			{
+				const size_t count = std::min<size_t>(8, width - x);
+				uint8_t value = 0;
+				for (size_t k = 0; k < count; ++k)
+					value |= (uint8_t)((src[x + k] >= threshold) << (7 - k));
+				*out++ = value;
 			}
 		}
-		else if (info_header.bit_count() == 24)
+
+		//one image row to one file row, the padding of out is left untouched
+		//luma is scratch for width bytes, needed by 1bpp output from more than one channel
+		void encode_row(const uint8_t* row, uint8_t* out, const file_layout& layout, size_t channels, uint8_t threshold, uint8_t* luma)
 		{
-			image image_copy = _image;
-			for (int i = 0; i < height; ++i)
+			if (layout.bit_count == 1)
 			{
-				uint8_t* a = image_copy.get_row_begin(i);
-				const uint8_t* const end = image_copy.get_row_end(i);
-				while (a < end)
+				if (channels > 1)
 				{
-					uint8_t _r = a[0];
-					a[0] = a[2];
-					a[2] = _r;
-					a += 3;
+					luma_row(row, layout.width, channels, false, gray_weights(color_matrix::bt601), luma);
+					row = luma;
 				}
+				pack_threshold_row(row, layout.width, threshold, out);
 			}
-			stream.write(image_copy.data(), sizeof(uint8_t), image_copy.pitch() * image_copy.height());
+			else if (layout.bit_count == 24)
+			{
+				if (channels == 3)
+				{
+					swizzle_row<3>(row, out, layout.width);
+					return;
+				}
+				for (int x = 0; x < layout.width; ++x, row += channels, out += 3)
+				{
+					out[0] = row[2];
+					out[1] = row[1];
+					out[2] = row[0];
+				}
+			}
+			else
+			{
+				swizzle_row<4>(row, out, layout.width);
+			}
+		}
+	}
+
+	size_t writer::encoded_size(const dib_header& info_header)
+	{
+		return (size_t)layout_of(info_header).file_size;
+	}
+
+	size_t writer::write(uint8_t* data, size_t capacity, main_header& _main_header, const dib_header& info_header, const_image_view _image)
+	{
+		const file_layout layout = compute_layout(_main_header, info_header, _image);
+		if (capacity < layout.file_size)
+			throw exception(error_code::invalid_argument, "Buffer is smaller than the encoded size.");
+
+		const std::vector<uint8_t> headers = encode_headers(_main_header, info_header, layout);
+		memcpy(data, headers.data(), headers.size());
+
+		std::vector<uint8_t> luma(luma_size(layout, _image));
+
+		//rows are encoded in place, only the padding is cleared separately
+		for (int i = 0; i < layout.height; ++i)
+		{
+			const int y = layout.flipped ? layout.height - 1 - i : i;
+			uint8_t* out = data + layout.offset + layout.row_size * i;
+			const size_t used = (layout.bit_count * layout.width + 7) / 8;
+			memset(out + used, 0, layout.row_size - used);
+			encode_row(_image.get_row_begin(y), out, layout, _image.channels(), _threshold, luma.data());
 		}
+		return (size_t)layout.file_size;
+	}
+
+	void writer::write(output_stream& stream, main_header& _main_header, const dib_header& info_header, const_image_view _image)
+	{
+		output_stream_handle handle(stream);
+
+		const file_layout layout = compute_layout(_main_header, info_header, _image);
+		const std::vector<uint8_t> headers = encode_headers(_main_header, info_header, layout);
+		stream.write(headers.data(), sizeof(uint8_t), headers.size());
+
+		//rows are encoded straight from the view, so crops and tiles are written without a copy
+		std::vector<uint8_t> dataToWrite(layout.row_size, 0);
+		std::vector<uint8_t> luma(luma_size(layout, _image));
+		for (int i = 0; i < layout.height; ++i)
+		{
+			const int y = layout.flipped ? layout.height - 1 - i : i;
+			encode_row(_image.get_row_begin(y), &dataToWrite[0], layout, _image.channels(), _threshold, luma.data());
+			stream.write(&dataToWrite[0], sizeof(uint8_t), dataToWrite.size());
+		}
+	}
+
+	void writer::write_parallel(positional_output_stream& stream, main_header& _main_header, const dib_header& info_header, const_image_view _image, size_t threads)
+	{
+		output_stream_handle handle(stream);
+
+		const file_layout layout = compute_layout(_main_header, info_header, _image);
+		const std::vector<uint8_t> headers = encode_headers(_main_header, info_header, layout);
+
+		stream.reserve(layout.file_size);
+		stream.write_at(0, headers.data(), headers.size());
+
+		//a band of image rows is a contiguous range of file rows in both orientations
+		const int band_rows = (int)std::max<size_t>(1, parallel_band_size / layout.row_size);
+		const size_t bands = (layout.height + band_rows - 1) / band_rows;
+
+		parallel_for(bands, threads, [&](size_t band)
+		{
+			const int first = (int)band * band_rows;
+			const int count = std::min(band_rows, layout.height - first);
+			const int first_file_row = layout.flipped ? layout.height - first - count : first;
+
+			std::vector<uint8_t> buffer(layout.row_size * count, 0);
+			std::vector<uint8_t> luma(luma_size(layout, _image));
+			for (int k = 0; k < count; ++k)
+			{
+				const int y = first + k;
+				const int file_row = layout.flipped ? layout.height - 1 - y : y;
+				encode_row(_image.get_row_begin(y), buffer.data() + layout.row_size * (file_row - first_file_row), layout, _image.channels(), _threshold, luma.data());
+			}
+			stream.write_at(layout.offset + (uint64_t)layout.row_size * first_file_row, buffer.data(), buffer.size());
+		});
 	}
 
 }
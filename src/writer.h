@@ -6,6 +6,7 @@
 #include "stream.h"
 #include "data_types.h"
 #include "image.h"
+#include "image_view.h"
 
 namespace fbmp
 {
@@ -13,7 +14,26 @@ namespace fbmp
 	class writer
 	{
 	public:
-		void write(output_stream& stream, main_header& header, const dib_header& dib_header, const image& image);
+		void write(output_stream& stream, main_header& header, const dib_header& dib_header, const_image_view image);
+
+		//encodes straight into data without intermediate copies, returns the number of bytes written
+		size_t write(uint8_t* data, size_t capacity, main_header& header, const dib_header& dib_header, const_image_view image);
+
+		//exact number of bytes write produces for the header
+		static size_t encoded_size(const dib_header& dib_header);
+
+		//bands of rows are encoded on up to threads threads and written at their precomputed offsets
+		//the whole file is reserved first, so the bands can land in any order
+		void write_parallel(positional_output_stream& stream, main_header& header, const dib_header& dib_header, const_image_view image, size_t threads);
+
+		static const size_t parallel_band_size = 4 * 1024 * 1024;	//bytes of file rows encoded by one task
+
+		//1bpp output: pixels at or above the threshold are white, 3 and 4 channel images are compared by luma
+		void set_threshold(uint8_t threshold) { _threshold = threshold; }
+		uint8_t threshold() const { return _threshold; }
+
+	private:
+		uint8_t _threshold = 128;
 	};
 
 }
@@ -0,0 +1,697 @@
+
+//fbmp - command line front end of the library for whole directory trees
+//
+//	fbmp <command> [options] <input> [output]
+//
+//input is a bmp file, a pack or a directory searched recursively for *.bmp files, a directory output mirrors the input tree
+//every file is a job for a pool of worker threads; jobs wait until their pixels fit in the memory budget
+
+#include <cstdio>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <cctype>
+#include <string>
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <memory>
+#include <algorithm>
+#include <condition_variable>
+#if defined(_WIN32)
+#include <windows.h>
+#include <direct.h>
+#include <sys/stat.h>
+#else
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#endif
+
+#include "fast_bmp.h"
+#include "parallel.h"
+
+using namespace fbmp;
+
+namespace
+{
+
+	enum class command
+	{
+		probe,
+		convert,
+		flip,
+		rotate,
+		crop,
+		thumbnail,
+		pack
+	};
+
+	struct options
+	{
+		command cmd = command::probe;
+		std::string input;
+		std::string output;
+
+		int bpp = 24;							//convert
+		bool vertical = false;					//flip
+		rotation angle = rotation::rotate_90;	//rotate
+		size_t rect[4] = {0, 0, 0, 0};			//crop: x, y, width, height
+		size_t size = 128;						//thumbnail: longest side
+
+		size_t threads = 0;						//0 - one per hardware thread
+		uint64_t memory = 1024ull << 20;		//bytes of pixels decoded at the same time
+		bool quiet = false;
+	};
+
+	struct job
+	{
+		std::string input;
+		std::string output;
+		uint64_t input_size;
+		size_t entry;		//index in the input pack, npos for files
+	};
+
+	const char* usage =
+		"usage: fbmp <command> [options] <input> [output]\n"
+		"\n"
+		"commands:\n"
+		"  probe                      print the headers of every input file\n"
+		"  convert --bpp 1|8|24|32    rewrite with another bit count, 8 is a gray palette\n"
+		"  flip [--vertical]          mirror left to right, or top to bottom\n"
+		"  rotate --angle 90|180|270  turn clockwise\n"
+		"  crop --rect x,y,w,h        cut out a rectangle\n"
+		"  thumbnail --size n         box filtered copy whose longest side is n pixels\n"
+		"  pack                       store every input file in one pack file\n"
+		"\n"
+		"a .pack input runs the command on every entry, outputs are named after the entries\n"
+		"\n"
+		"options:\n"
+		"  -j n                       worker threads, all hardware threads by default\n"
+		"  --memory mb                pixels decoded at the same time, 1024 by default\n"
+		"  --quiet                    print the summary only\n";
+
+	//----------------------------------------------------------------------------------------------
+
+	//blocks callers until their bytes fit in the budget, so memory in flight stays bounded for any number of threads
+	class memory_gate
+	{
+	public:
+		explicit memory_gate(uint64_t capacity)
+			: _budget(capacity)
+		{}
+
+		void acquire(uint64_t bytes)
+		{
+			if (bytes > _budget.capacity())
+				throw exception(error_code::limit_exceeded, "Image needs more memory than the whole budget.");
+
+			std::unique_lock<std::mutex> lock(_mutex);
+			_released.wait(lock, [&]() { return _budget.try_acquire(bytes); });
+			_peak = std::max(_peak, _budget.used());
+		}
+
+		void release(uint64_t bytes)
+		{
+			{
+				std::lock_guard<std::mutex> lock(_mutex);
+				_budget.release(bytes);
+			}
+			_released.notify_all();
+		}
+
+		uint64_t capacity() const { return _budget.capacity(); }
+		uint64_t peak() const { return _peak; }
+
+	private:
+		memory_budget _budget;
+		std::mutex _mutex;
+		std::condition_variable _released;
+		uint64_t _peak = 0;
+	};
+
+	class gate_reservation
+	{
+	public:
+		gate_reservation(memory_gate& gate, uint64_t bytes)
+			: _gate(gate)
+			, _bytes(bytes)
+		{
+			_gate.acquire(_bytes);
+		}
+
+		gate_reservation(const gate_reservation&) = delete;
+		gate_reservation& operator=(const gate_reservation&) = delete;
+
+		~gate_reservation()
+		{
+			_gate.release(_bytes);
+		}
+
+	private:
+		memory_gate& _gate;
+		uint64_t _bytes;
+	};
+
+	//nanoseconds spent in each stage summed over all workers
+	struct stage_times
+	{
+		std::atomic<uint64_t> read{0};
+		std::atomic<uint64_t> process{0};
+		std::atomic<uint64_t> write{0};
+	};
+
+	class stage_timer
+	{
+	public:
+		explicit stage_timer(std::atomic<uint64_t>& total)
+			: _total(total)
+			, _start(std::chrono::steady_clock::now())
+		{}
+
+		~stage_timer()
+		{
+			const auto elapsed = std::chrono::steady_clock::now() - _start;
+			_total += (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+		}
+
+	private:
+		std::atomic<uint64_t>& _total;
+		std::chrono::steady_clock::time_point _start;
+	};
+
+	//----------------------------------------------------------------------------------------------
+
+	bool is_directory(const std::string& path)
+	{
+		struct stat info;
+		return stat(path.c_str(), &info) == 0 && (info.st_mode & S_IFMT) == S_IFDIR;
+	}
+
+	uint64_t file_size(const std::string& path)
+	{
+#if defined(_WIN32)
+		struct _stat64 info;
+		return _stat64(path.c_str(), &info) == 0 ? (uint64_t)info.st_size : 0;
+#else
+		struct stat info;
+		return stat(path.c_str(), &info) == 0 ? (uint64_t)info.st_size : 0;
+#endif
+	}
+
+	bool has_bmp_extension(const std::string& name)
+	{
+		if (name.size() < 4)
+			return false;
+		std::string extension = name.substr(name.size() - 4);
+		std::transform(extension.begin(), extension.end(), extension.begin(), [](char c) { return (char)tolower((unsigned char)c); });
+		return extension == ".bmp";
+	}
+
+	//names inside a directory, without . and ..
+	std::vector<std::string> list_directory(const std::string& path)
+	{
+		std::vector<std::string> names;
+#if defined(_WIN32)
+		WIN32_FIND_DATAA entry;
+		HANDLE find = FindFirstFileA((path + "\\*").c_str(), &entry);
+		if (find == INVALID_HANDLE_VALUE)
+			return names;
+		do
+		{
+			if (strcmp(entry.cFileName, ".") && strcmp(entry.cFileName, ".."))
+				names.push_back(entry.cFileName);
+		} while (FindNextFileA(find, &entry));
+		FindClose(find);
+#else
+		DIR* dir = opendir(path.c_str());
+		if (!dir)
+			return names;
+		while (dirent* entry = readdir(dir))
+		{
+			if (strcmp(entry->d_name, ".") && strcmp(entry->d_name, ".."))
+				names.push_back(entry->d_name);
+		}
+		closedir(dir);
+#endif
+		std::sort(names.begin(), names.end());
+		return names;
+	}
+
+	void collect_jobs(const std::string& input, const std::string& output, std::vector<job>& jobs)
+	{
+		for (const std::string& name : list_directory(input))
+		{
+			const std::string path = input + "/" + name;
+			const std::string target = output.empty() ? std::string() : output + "/" + name;
+			if (is_directory(path))
+				collect_jobs(path, target, jobs);
+			else if (has_bmp_extension(name))
+				jobs.push_back(job{path, target, file_size(path), pack_reader::npos});
+		}
+	}
+
+	bool has_pack_extension(const std::string& name)
+	{
+		return name.size() > 5 && name.compare(name.size() - 5, 5, ".pack") == 0;
+	}
+
+	//pack entries are decoded from the mapping in place, the pack stays open for the whole run
+	void collect_pack_jobs(const pack_reader& pack, const std::string& input, const std::string& output, std::vector<job>& jobs)
+	{
+		for (size_t i = 0; i < pack.size(); ++i)
+		{
+			const pack_entry& entry = pack.entry(i);
+			const std::string target = output.empty() ? std::string() : output + "/" + entry.name;
+			jobs.push_back(job{input + ":" + entry.name, target, entry.size, i});
+		}
+	}
+
+	void make_directory(const std::string& path)
+	{
+#if defined(_WIN32)
+		_mkdir(path.c_str());
+#else
+		mkdir(path.c_str(), 0777);
+#endif
+	}
+
+	//creates every missing directory on the way to a file
+	void make_parent_directories(const std::string& file)
+	{
+		for (size_t slash = file.find_first_of("/\\", 1); slash != std::string::npos; slash = file.find_first_of("/\\", slash + 1))
+			make_directory(file.substr(0, slash));
+	}
+
+	//----------------------------------------------------------------------------------------------
+
+	//1 channel images are black and white, see reader::output_channels
+	int bit_count_for(size_t channels)
+	{
+		return channels == 1 ? 1 : channels == 4 ? 32 : 24;
+	}
+
+	void write_image(const std::string& path, const_image_view img, int bit_count)
+	{
+		main_header header;
+		header.magic[0] = 'B';
+		header.magic[1] = 'M';
+
+		dib_bitmap_info_header info;
+		info.header.width = (int32_t)img.width();
+		info.header.height = (int32_t)img.height();
+		info.header.planes = 1;
+		info.header.bit_count = (int16_t)bit_count;
+
+		make_parent_directories(path);
+		file_output_stream stream(path.c_str());
+		writer().write(stream, header, info, img);
+	}
+
+	//averages the source pixels covered by every destination pixel
+	void downscale(const_image_view src, const image_view& dst)
+	{
+		const size_t channels = src.channels();
+		std::vector<size_t> column(dst.width() + 1);
+		for (size_t x = 0; x <= dst.width(); ++x)
+			column[x] = x * src.width() / dst.width();
+
+		std::vector<uint32_t> sum(dst.width() * channels);
+		for (size_t y = 0; y < dst.height(); ++y)
+		{
+			const size_t top = y * src.height() / dst.height();
+			const size_t bottom = std::max((y + 1) * src.height() / dst.height(), top + 1);
+
+			std::fill(sum.begin(), sum.end(), 0);
+			for (size_t sy = top; sy < bottom; ++sy)
+			{
+				const uint8_t* row = src.get_row_begin(sy);
+				for (size_t x = 0; x < dst.width(); ++x)
+				{
+					const size_t right = std::max(column[x + 1], column[x] + 1);
+					for (size_t sx = column[x]; sx < right; ++sx)
+						for (size_t c = 0; c < channels; ++c)
+							sum[x * channels + c] += row[sx * channels + c];
+				}
+			}
+
+			uint8_t* out = dst.get_row_begin(y);
+			for (size_t x = 0; x < dst.width(); ++x)
+			{
+				const uint32_t count = (uint32_t)((bottom - top) * (std::max(column[x + 1], column[x] + 1) - column[x]));
+				for (size_t c = 0; c < channels; ++c)
+					out[x * channels + c] = (uint8_t)((sum[x * channels + c] + count / 2) / count);
+			}
+		}
+	}
+
+	std::string probe_line(const job& item, const reader& decoder)
+	{
+		const bmp_info& info = decoder.get_info();
+		char line[512];
+		snprintf(line, sizeof(line), "%s: %dx%d %dbpp, %d byte header, %s, compression %d, %d palette colors, %llu bytes",
+			item.input.c_str(), info.width, info.abs_height(), info.bit_count, info.header_size,
+			info.flipped() ? "bottom-up" : "top-down", info.compression, info.palette_colors,
+			(unsigned long long)item.input_size);
+		return line;
+	}
+
+	std::unique_ptr<input_stream> open_input(const job& item, const pack_reader& pack)
+	{
+		if (item.entry != pack_reader::npos)
+			return std::unique_ptr<input_stream>(new memory_input_stream(pack.stream(item.entry)));
+		return std::unique_ptr<input_stream>(new file_input_stream(item.input.c_str()));
+	}
+
+	//runs one file through the requested command, returns a line for the report
+	std::string run_job(const options& opt, const job& item, const pack_reader& pack, memory_gate& gate, stage_times& times)
+	{
+		const std::unique_ptr<input_stream> stream = open_input(item, pack);
+		input_stream& input = *stream;
+
+		//bit count changes other than 1bpp are streamed by the transcoder and never hold the whole image
+		if (opt.cmd == command::convert && opt.bpp != 1)
+		{
+			transcode_options transcode;
+			transcode.format = opt.bpp == 8 ? transcode_format::gray8 : opt.bpp == 32 ? transcode_format::bgra32 : transcode_format::bgr24;
+
+			gate_reservation reservation(gate, transcode.chunk_size * 2);
+			stage_timer timer(times.process);
+			make_parent_directories(item.output);
+			file_output_stream output(item.output.c_str());
+			transcoder().transcode(input, output, transcode);
+			return item.output;
+		}
+
+		reader decoder(input);
+		input_stream_handle handle(input);
+		decoder.read_header();
+		decoder.read_dib_header();
+		if (opt.cmd == command::probe)
+			return probe_line(item, decoder);
+		decoder.read_palette();
+
+		const bmp_info& info = decoder.get_info();
+		const size_t width = info.width;
+		const size_t height = info.abs_height();
+		const size_t channels = decoder.output_channels();
+		const uint64_t decoded = (uint64_t)width * height * channels;
+
+		if (opt.cmd == command::crop)
+		{
+			const size_t x = std::min(opt.rect[0], width);
+			const size_t y = std::min(opt.rect[1], height);
+			const size_t crop_width = std::min(opt.rect[2], width - x);
+			const size_t crop_height = std::min(opt.rect[3], height - y);
+			if (!crop_width || !crop_height)
+				throw exception(error_code::invalid_argument, "Crop rectangle is outside the image.");
+
+			gate_reservation reservation(gate, (uint64_t)crop_width * crop_height * channels);
+			image region(crop_width, crop_height, channels);
+			{
+				stage_timer timer(times.read);
+				decoder.read_region(x, y, image_view(region));
+			}
+			stage_timer timer(times.write);
+			write_image(item.output, const_image_view(region), bit_count_for(channels));
+			return item.output;
+		}
+
+		if (opt.cmd == command::thumbnail)
+		{
+			const size_t longest = std::max(width, height);
+			const size_t thumb_width = std::max<size_t>(width * opt.size / longest, 1);
+			const size_t thumb_height = std::max<size_t>(height * opt.size / longest, 1);
+
+			gate_reservation reservation(gate, decoded + (uint64_t)thumb_width * thumb_height * channels);
+			image img(width, height, channels);
+			{
+				stage_timer timer(times.read);
+				decoder.decode_image(decode_target::interleaved(img.data(), img.pitch()));
+			}
+			image thumb(thumb_width, thumb_height, channels);
+			{
+				stage_timer timer(times.process);
+				downscale(const_image_view(img), image_view(thumb));
+			}
+			stage_timer timer(times.write);
+			write_image(item.output, const_image_view(thumb), bit_count_for(channels));
+			return item.output;
+		}
+
+		gate_reservation reservation(gate, decoded);
+
+		//rotation happens while decoding, the rows go straight to their turned place
+		if (opt.cmd == command::rotate)
+		{
+			const bool swapped = opt.angle != rotation::rotate_180;
+			image turned(swapped ? height : width, swapped ? width : height, channels);
+			decode_target target = decode_target::interleaved(turned.data(), turned.pitch());
+			target.rotate = opt.angle;
+			{
+				stage_timer timer(times.read);
+				decoder.decode_image(target);
+			}
+			stage_timer timer(times.write);
+			write_image(item.output, const_image_view(turned), bit_count_for(channels));
+			return item.output;
+		}
+
+		image img(width, height, channels);
+		{
+			stage_timer timer(times.read);
+			decoder.decode_image(decode_target::interleaved(img.data(), img.pitch()));
+		}
+		if (opt.cmd == command::flip)
+		{
+			stage_timer timer(times.process);
+			if (opt.vertical)
+				flip_vertical(image_view(img));
+			else
+				flip_horizontal(image_view(img));
+		}
+
+		//convert to 1bpp thresholds the luma of color images
+		stage_timer timer(times.write);
+		write_image(item.output, const_image_view(img), opt.cmd == command::flip ? bit_count_for(channels) : 1);
+		return item.output;
+	}
+
+	//entries are named by their path below the input directory, with forward slashes
+	std::string entry_name(const options& opt, const job& item, bool directory)
+	{
+		std::string name = directory ? item.input.substr(opt.input.size() + 1) : item.input.substr(item.input.find_last_of("/\\") + 1);
+		std::replace(name.begin(), name.end(), '\\', '/');
+		return name;
+	}
+
+	//copies the files one after another into the pack, one writer so it runs on the calling thread
+	size_t run_pack(const options& opt, const std::vector<job>& jobs, bool directory)
+	{
+		make_parent_directories(opt.output);
+		file_output_stream output(opt.output.c_str());
+		pack_writer pack(output);
+		size_t failures = 0;
+		for (const job& item : jobs)
+		{
+			try
+			{
+				file_input_stream input(item.input.c_str());
+				pack.add(entry_name(opt, item, directory), input);
+				if (!opt.quiet)
+					printf("%s\n", item.input.c_str());
+			}
+			catch (const std::exception& e)
+			{
+				fprintf(stderr, "%s: %s\n", item.input.c_str(), e.what());
+				++failures;
+			}
+		}
+		pack.finish();
+		return failures;
+	}
+
+	//----------------------------------------------------------------------------------------------
+
+	bool parse_size(const char* text, size_t& value)
+	{
+		char* end = nullptr;
+		const unsigned long long parsed = strtoull(text, &end, 10);
+		value = (size_t)parsed;
+		return end != text && *end == 0;
+	}
+
+	bool parse_options(int argc, char** argv, options& opt)
+	{
+		if (argc < 3)
+			return false;
+
+		const std::string name = argv[1];
+		if (name == "probe") opt.cmd = command::probe;
+		else if (name == "convert") opt.cmd = command::convert;
+		else if (name == "flip") opt.cmd = command::flip;
+		else if (name == "rotate") opt.cmd = command::rotate;
+		else if (name == "crop") opt.cmd = command::crop;
+		else if (name == "thumbnail") opt.cmd = command::thumbnail;
+		else if (name == "pack") opt.cmd = command::pack;
+		else return false;
+
+		std::vector<std::string> paths;
+		for (int i = 2; i < argc; ++i)
+		{
+			const std::string arg = argv[i];
+			const bool has_value = i + 1 < argc;
+			size_t value = 0;
+
+			if (arg == "--bpp" && has_value && parse_size(argv[++i], value) && (value == 1 || value == 8 || value == 24 || value == 32))
+				opt.bpp = (int)value;
+			else if (arg == "--vertical")
+				opt.vertical = true;
+			else if (arg == "--angle" && has_value && parse_size(argv[++i], value) && (value == 90 || value == 180 || value == 270))
+				opt.angle = value == 90 ? rotation::rotate_90 : value == 180 ? rotation::rotate_180 : rotation::rotate_270;
+			else if (arg == "--rect" && has_value)
+			{
+				unsigned long long rect[4];
+				if (sscanf(argv[++i], "%llu,%llu,%llu,%llu", &rect[0], &rect[1], &rect[2], &rect[3]) != 4)
+					return false;
+				for (int k = 0; k < 4; ++k)
+					opt.rect[k] = (size_t)rect[k];
+			}
+			else if (arg == "--size" && has_value && parse_size(argv[++i], value) && value > 0)
+				opt.size = value;
+			else if (arg == "-j" && has_value && parse_size(argv[++i], value))
+				opt.threads = value;
+			else if (arg == "--memory" && has_value && parse_size(argv[++i], value) && value > 0)
+				opt.memory = (uint64_t)value << 20;
+			else if (arg == "--quiet")
+				opt.quiet = true;
+			else if (arg.size() > 1 && arg[0] == '-')
+				return false;
+			else
+				paths.push_back(arg);
+		}
+
+		if (paths.size() != (opt.cmd == command::probe ? 1u : 2u))
+			return false;
+		opt.input = paths[0];
+		if (paths.size() == 2)
+			opt.output = paths[1];
+		if (!opt.threads)
+			opt.threads = std::max(std::thread::hardware_concurrency(), 1u);
+		return true;
+	}
+
+	double seconds(uint64_t nanoseconds)
+	{
+		return nanoseconds / 1e9;
+	}
+
+	double megabytes(uint64_t bytes)
+	{
+		return bytes / (1024.0 * 1024.0);
+	}
+
+}
+
+int main(int argc, char** argv)
+{
+	options opt;
+	if (!parse_options(argc, argv, opt))
+	{
+		fputs(usage, stderr);
+		return 2;
+	}
+
+	std::vector<job> jobs;
+	pack_reader pack;
+	const bool directory = is_directory(opt.input);
+	if (directory)
+		collect_jobs(opt.input, opt.cmd == command::pack ? std::string() : opt.output, jobs);
+	else if (has_pack_extension(opt.input) && opt.cmd != command::pack)
+	{
+		try
+		{
+			pack = pack_reader(opt.input.c_str());
+		}
+		catch (const std::exception& e)
+		{
+			fprintf(stderr, "%s: %s\n", opt.input.c_str(), e.what());
+			return 1;
+		}
+		collect_pack_jobs(pack, opt.input, opt.output, jobs);
+	}
+	else
+		jobs.push_back(job{opt.input, opt.output, file_size(opt.input), pack_reader::npos});
+
+	memory_gate gate(opt.memory);
+	stage_times times;
+
+	if (opt.cmd == command::pack)
+	{
+		const auto start = std::chrono::steady_clock::now();
+		size_t failures = 0;
+		try
+		{
+			failures = run_pack(opt, jobs, directory);
+		}
+		catch (const std::exception& e)
+		{
+			fprintf(stderr, "%s: %s\n", opt.output.c_str(), e.what());
+			return 1;
+		}
+		const double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+		uint64_t bytes_in = 0;
+		for (const job& item : jobs)
+			bytes_in += item.input_size;
+		printf("%zu files, %zu failed, %.3f s, %.1f MB packed into %s\n", jobs.size(), failures, wall, megabytes(bytes_in), opt.output.c_str());
+		return failures ? 1 : 0;
+	}
+	std::vector<std::string> lines(jobs.size());
+	std::vector<char> failed(jobs.size(), 0);
+	std::mutex print_mutex;
+
+	const auto start = std::chrono::steady_clock::now();
+	parallel_for(jobs.size(), opt.threads, [&](size_t i)
+	{
+		try
+		{
+			lines[i] = run_job(opt, jobs[i], pack, gate, times);
+		}
+		catch (const std::exception& e)
+		{
+			lines[i] = jobs[i].input + ": " + e.what();
+			failed[i] = 1;
+		}
+
+		if (!opt.quiet || failed[i])
+		{
+			std::lock_guard<std::mutex> lock(print_mutex);
+			fprintf(failed[i] ? stderr : stdout, "%s\n", lines[i].c_str());
+		}
+	});
+	const double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	size_t failures = 0;
+	uint64_t bytes_in = 0;
+	uint64_t bytes_out = 0;
+	for (size_t i = 0; i < jobs.size(); ++i)
+	{
+		failures += failed[i] ? 1 : 0;
+		bytes_in += jobs[i].input_size;
+		if (!failed[i] && !jobs[i].output.empty())
+			bytes_out += file_size(jobs[i].output);
+	}
+
+	printf("%zu files, %zu failed, %.3f s on %zu threads\n", jobs.size(), failures, wall, opt.threads);
+	printf("  read     %8.3f s\n", seconds(times.read));
+	printf("  process  %8.3f s\n", seconds(times.process));
+	printf("  write    %8.3f s\n", seconds(times.write));
+	if (wall > 0)
+		printf("  %.1f files/s, %.1f MB/s in, %.1f MB/s out\n", jobs.size() / wall, megabytes(bytes_in) / wall, megabytes(bytes_out) / wall);
+	printf("  peak memory in flight %.1f of %.1f MB\n", megabytes(gate.peak()), megabytes(gate.capacity()));
+
+	return failures ? 1 : 0;
+}